@@ -0,0 +1,218 @@
+/* corpus.cpp */
+
+//
+// Implementation of the synthetic corpus generators
+//
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <random>
+
+#include "corpus.h"
+
+// bytes generated per write
+static const size_t GENERATE_BUFFER_SIZE = 1 << 20;
+
+// common English words, most frequent first (they are drawn with Zipf weights by rank)
+static const char* WORDS[] = {
+    "the", "of", "and", "to", "a", "in", "is", "it", "you", "that", "he", "was", "for", "on", "are", "with",
+    "as", "his", "they", "be", "at", "one", "have", "this", "from", "or", "had", "by", "not", "word", "but",
+    "what", "some", "we", "can", "out", "other", "were", "all", "there", "when", "up", "use", "your", "how",
+    "said", "an", "each", "she", "which", "do", "their", "time", "if", "will", "way", "about", "many", "then",
+    "them", "write", "would", "like", "so", "these", "her", "long", "make", "thing", "see", "him", "two",
+    "has", "look", "more", "day", "could", "go", "come", "did", "number", "sound", "no", "most", "people",
+    "my", "over", "know", "water", "than", "call", "first", "who", "may", "down", "side", "been", "now",
+    "find", "any", "new", "work", "part", "take", "get", "place", "made", "live", "where", "after", "back",
+    "little", "only", "round", "man", "year", "came", "show", "every", "good", "me", "give", "our", "under",
+    "name", "very", "through", "just", "form", "sentence", "great", "think", "say", "help", "low", "line",
+    "differ", "turn", "cause", "much", "mean", "before", "move", "right", "boy", "old", "too", "same", "tell",
+    "does", "set", "three", "want", "air", "well", "also", "play", "small", "end", "put", "home", "read",
+    "hand", "port", "large", "spell", "add", "even", "land", "here", "must", "big", "high", "such", "follow",
+    "act", "why", "ask", "men", "change", "went", "light", "kind", "off", "need", "house", "picture", "try",
+    "again", "animal", "point", "mother", "world", "near", "build", "self", "earth", "father", "head"
+};
+
+// weights 1/rank^s for `count` ranks
+static std::vector<double> zipfWeights(size_t count, double s)
+{
+    std::vector<double> weights(count);
+    for (size_t k = 0; k < count; k++)
+    {
+        weights[k] = 1.0 / std::pow(static_cast<double>(k + 1), s);
+    }
+    return weights;
+}
+
+/// <summary>
+/// A Generator produces the next buffer of a corpus. It keeps whatever state
+/// has to carry over from one buffer to the next (the random engine, the
+/// current line length, the record counter).
+/// </summary>
+class Generator {
+public:
+    explicit Generator(const std::string& kind)
+        : kind(kind), rng(0x5eed + kind.size()), zipf(), word(), column(0), startSentence(true), record(0), sample(0.0)
+    {
+        std::vector<double> byteWeights = zipfWeights(256, 1.2);
+        zipf = std::discrete_distribution<int>(byteWeights.begin(), byteWeights.end());
+        std::vector<double> wordWeights = zipfWeights(sizeof(WORDS) / sizeof(WORDS[0]), 1.0);
+        word = std::discrete_distribution<int>(wordWeights.begin(), wordWeights.end());
+
+        // zipf ranks map to byte values in a fixed shuffled order, so the common bytes are not just 0, 1, 2...
+        for (int c = 0; c < 256; c++)
+        {
+            rankToByte[c] = static_cast<unsigned char>(c);
+        }
+        std::shuffle(rankToByte, rankToByte + 256, rng);
+    }
+
+    bool known() const
+    {
+        return kind == "uniform" || kind == "zipf" || kind == "english" || kind == "binary" || kind == "tiny";
+    }
+
+    // fill `out` with the next `count` bytes
+    void fill(unsigned char* out, size_t count)
+    {
+        if (kind == "uniform")
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                out[i] = static_cast<unsigned char>(rng());
+            }
+        }
+        else if (kind == "zipf")
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                out[i] = rankToByte[zipf(rng)];
+            }
+        }
+        else if (kind == "binary")
+        {
+            fillBinary(out, count);
+        }
+        else
+        {
+            fillText(out, count);
+        }
+    }
+
+private:
+    // words, spaces, punctuation and line breaks; a word cut off at the end of a buffer continues in the next
+    void fillText(unsigned char* out, size_t count)
+    {
+        size_t i = 0;
+        while (i < count)
+        {
+            if (pending.empty())
+            {
+                pending = nextWord();
+            }
+            size_t take = std::min(pending.size(), count - i);
+            std::memcpy(out + i, pending.data(), take);
+            pending.erase(0, take);
+            i += take;
+        }
+    }
+
+    std::string nextWord()
+    {
+        std::string text = WORDS[word(rng)];
+        if (startSentence)
+        {
+            text[0] = static_cast<char>(std::toupper(static_cast<unsigned char>(text[0])));
+            startSentence = false;
+        }
+
+        // end the sentence now and then, or pause with a comma
+        unsigned roll = rng() % 100;
+        if (roll < 7)
+        {
+            text += '.';
+            startSentence = true;
+        }
+        else if (roll < 11)
+        {
+            text += ',';
+        }
+
+        // wrap lines at about 72 columns
+        column += text.size() + 1;
+        if (column > 72)
+        {
+            text += '\n';
+            column = 0;
+        }
+        else
+        {
+            text += ' ';
+        }
+        return text;
+    }
+
+    // 32-byte records: a counter, a flags word, a slowly drifting double, and zero padding
+    void fillBinary(unsigned char* out, size_t count)
+    {
+        size_t i = 0;
+        while (i < count)
+        {
+            if (pending.empty())
+            {
+                unsigned char bytes[32] = {};
+                uint32_t flags = (rng() % 8 == 0) ? 1u : 0u;
+                sample += std::normal_distribution<double>(0.0, 1.0)(rng);
+                std::memcpy(bytes, &record, sizeof(record));
+                std::memcpy(bytes + 8, &flags, sizeof(flags));
+                std::memcpy(bytes + 16, &sample, sizeof(sample));
+                pending.assign(reinterpret_cast<const char*>(bytes), sizeof(bytes));
+                record++;
+            }
+            size_t take = std::min(pending.size(), count - i);
+            std::memcpy(out + i, pending.data(), take);
+            pending.erase(0, take);
+            i += take;
+        }
+    }
+
+    std::string kind;
+    std::mt19937_64 rng;
+    std::discrete_distribution<int> zipf;
+    std::discrete_distribution<int> word;
+    unsigned char rankToByte[256];
+    std::string pending; // bytes generated but not yet written
+    size_t column;
+    bool startSentence;
+    uint64_t record;
+    double sample;
+};
+
+// write `size` bytes of the given kind to `fileName`
+int generateCorpus(const std::string& kind, uint64_t size, const std::string& fileName)
+{
+    Generator generator(kind);
+    if (!generator.known())
+    {
+        return 1;
+    }
+
+    std::ofstream out(fileName, std::ofstream::binary);
+    if (!out)
+    {
+        return 1;
+    }
+
+    std::vector<unsigned char> buffer(GENERATE_BUFFER_SIZE);
+    for (uint64_t written = 0; written < size; )
+    {
+        size_t count = static_cast<size_t>(std::min<uint64_t>(buffer.size(), size - written));
+        generator.fill(buffer.data(), count);
+        out.write(reinterpret_cast<const char*>(buffer.data()), count);
+        written += count;
+    }
+    out.close();
+    return out ? 0 : 1;
+}
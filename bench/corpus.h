@@ -0,0 +1,29 @@
+/* corpus.h */
+
+//
+// Synthetic inputs for benchmarking the encoders and the decoder
+//
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/// <summary>
+/// Each corpus kind stresses the coder differently:
+///     uniform  every byte value equally likely (nothing to compress, longest tables)
+///     zipf     byte values with Zipf-distributed frequencies (very skewed, deep trees)
+///     english  words drawn from a small English vocabulary, with punctuation and line breaks
+///     binary   fixed-size records of counters, floating point samples and zero padding
+///     tiny     English-like text of only a few bytes to a few KB (per-file overheads)
+/// Generation is seeded, so the same kind and size always give the same bytes.
+/// </summary>
+const std::vector<std::string> CORPUS_KINDS = {"uniform", "zipf", "english", "binary", "tiny"};
+
+// sizes used for the tiny corpus, whatever sizes were asked for
+const std::vector<uint64_t> TINY_SIZES = {16, 512, 4096};
+
+// write `size` bytes of the given kind to `fileName`, a buffer at a time so any size fits in memory
+// returns 0 on success, 1 if the kind is unknown or the file cannot be written
+int generateCorpus(const std::string& kind, uint64_t size, const std::string& fileName);
@@ -0,0 +1,430 @@
+/* main.cpp */
+
+//
+// Benchmarks the three hc binaries over synthetic corpora
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "corpus.h"
+#include "options.h"
+
+using namespace std;
+using namespace std::chrono;
+
+/// <summary>
+/// Options picks what to run. Every encode-parallel run is also decoded with
+/// the same number of threads; encode-sequential output is decoded with one.
+/// </summary>
+struct Options {
+    string repoDir = "..";                 // where encode-sequential/, encode-parallel/ and decode/ live
+    string corpusDir = "corpus";           // generated inputs (kept between runs) and scratch space
+    vector<string> kinds = CORPUS_KINDS;
+    vector<uint64_t> sizes = {1 << 20, 16 << 20};
+    vector<int> threads = {1, 2, 4, 8};
+    vector<string> parallelArgs = {"--block-size", "1M"}; // extra encode-parallel options
+    int repeat = 1;                        // best of this many runs
+    string format = "csv";
+};
+
+/// <summary>
+/// One stage of one run. "total" is the wall-clock time of the whole
+/// process; the other stages are the ones it timed with --stats=csv.
+/// </summary>
+struct Row {
+    string corpus;
+    uint64_t size;
+    string program;
+    int threads;
+    string stage;
+    double ms;
+    double mbPerSec;
+    double speedup;  // vs the same program and stage with 1 thread (0 if there is no such run)
+    double ratio;    // encoded size / input size
+    long peakRssKb;
+    bool ok;         // the program succeeded (and for decode, gave back the input exactly)
+};
+
+struct RunResult {
+    bool ok;
+    double wallMs;
+    long peakRssKb;
+    vector<pair<string, double>> stages;
+};
+
+// split "a,b,c" (or "a b c" for `separator` ' ')
+static vector<string> split(const string& text, char separator)
+{
+    vector<string> parts;
+    stringstream stream(text);
+    string part;
+    while (getline(stream, part, separator))
+    {
+        if (!part.empty())
+        {
+            parts.push_back(part);
+        }
+    }
+    return parts;
+}
+
+//
+// Reads the arguments from the command line
+//
+int readArgs(int argc, char* argv[], Options& options)
+{
+    bool valid = true;
+    for (int i = 1; valid && i < argc; i++)
+    {
+        string option = argv[i];
+        bool hasValue = i + 1 < argc;
+        string value = hasValue ? argv[i + 1] : "";
+        if (option == "--repo" && hasValue)
+        {
+            options.repoDir = value;
+        }
+        else if (option == "--corpus" && hasValue)
+        {
+            options.corpusDir = value;
+        }
+        else if (option == "--kinds" && hasValue)
+        {
+            options.kinds = split(value, ',');
+            for (const string& kind : options.kinds)
+            {
+                valid = valid && find(CORPUS_KINDS.begin(), CORPUS_KINDS.end(), kind) != CORPUS_KINDS.end();
+            }
+        }
+        else if (option == "--sizes" && hasValue)
+        {
+            options.sizes.clear();
+            for (const string& part : split(value, ','))
+            {
+                uint64_t size = 0;
+                valid = valid && parseSize(part.c_str(), size) == 0;
+                options.sizes.push_back(size);
+            }
+        }
+        else if (option == "--threads" && hasValue)
+        {
+            options.threads.clear();
+            for (const string& part : split(value, ','))
+            {
+                int count = atoi(part.c_str());
+                valid = valid && count >= 1;
+                options.threads.push_back(count);
+            }
+        }
+        else if (option == "--parallel-args" && hasValue)
+        {
+            options.parallelArgs = split(value, ' ');
+        }
+        else if (option == "--repeat" && hasValue)
+        {
+            options.repeat = atoi(value.c_str());
+            valid = options.repeat >= 1;
+        }
+        else if (option == "--format" && hasValue)
+        {
+            options.format = value;
+            valid = (value == "csv" || value == "json");
+        }
+        else
+        {
+            valid = false;
+        }
+        i++;
+    }
+    if (!valid)
+    {
+        cout << endl;
+        cout << "Usage: " << argv[0] << " [--repo <dir with the three hc builds, default ..>] [--corpus <dir, default corpus>]" << endl;
+        cout << "       [--kinds uniform,zipf,english,binary,tiny] [--sizes 1M,16M,4G] [--threads 1,2,4,8]" << endl;
+        cout << "       [--parallel-args \"--block-size 1M\"] [--repeat <best of N>] [--format csv|json]" << endl;
+        cout << endl;
+        return 1;
+    }
+    return 0;
+}
+
+//
+// Runs a program in `workDir` with --stats=csv and collects its wall time, peak RSS and the stage times it reports
+// (in nanoseconds, so stages that take under a millisecond still get a rate)
+//
+RunResult runProgram(const vector<string>& args, const string& workDir)
+{
+    RunResult result = {false, 0.0, 0, {}};
+
+    int output[2];
+    if (pipe(output) != 0)
+    {
+        return result;
+    }
+
+    auto start = steady_clock::now();
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        close(output[0]);
+        close(output[1]);
+        return result;
+    }
+    if (pid == 0)
+    {
+        // child: run in the scratch directory with the stats (stderr) going to the pipe and the progress lines dropped
+        int devNull = open("/dev/null", O_WRONLY);
+        dup2(devNull, STDOUT_FILENO);
+        dup2(output[1], STDERR_FILENO);
+        close(devNull);
+        close(output[0]);
+        close(output[1]);
+        if (chdir(workDir.c_str()) != 0)
+        {
+            _exit(127);
+        }
+        string statsOption = "--stats=csv";
+        vector<char*> argv;
+        for (const string& arg : args)
+        {
+            argv.push_back(const_cast<char*>(arg.c_str()));
+        }
+        argv.push_back(statsOption.data());
+        argv.push_back(nullptr);
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+
+    // parent: read everything the child prints, then reap it
+    close(output[1]);
+    string text;
+    char buffer[4096];
+    ssize_t got;
+    while ((got = read(output[0], buffer, sizeof(buffer))) > 0)
+    {
+        text.append(buffer, static_cast<size_t>(got));
+    }
+    close(output[0]);
+
+    int status = 0;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) != pid)
+    {
+        return result;
+    }
+    result.wallMs = duration<double, milli>(steady_clock::now() - start).count();
+    result.peakRssKb = usage.ru_maxrss;
+    result.ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+
+    // e.g. "encode-parallel,stage_ns,histogram,,118204117"
+    for (const string& line : split(text, '\n'))
+    {
+        vector<string> fields = split(line, ',');
+        if (fields.size() == 4 && fields[1] == "stage_ns")
+        {
+            result.stages.push_back({fields[2], strtoull(fields[3].c_str(), nullptr, 10) / 1e6});
+        }
+    }
+    return result;
+}
+
+//
+// Runs a program `repeat` times and keeps the fastest run
+//
+RunResult bestOf(int repeat, const vector<string>& args, const string& workDir)
+{
+    RunResult best = runProgram(args, workDir);
+    for (int r = 1; r < repeat && best.ok; r++)
+    {
+        RunResult next = runProgram(args, workDir);
+        if (!next.ok || next.wallMs < best.wallMs)
+        {
+            best = next;
+        }
+    }
+    return best;
+}
+
+// do two files hold the same bytes?
+static bool sameContents(const string& a, const string& b)
+{
+    ifstream fa(a, ifstream::binary);
+    ifstream fb(b, ifstream::binary);
+    if (!fa || !fb)
+    {
+        return false;
+    }
+    vector<char> bufferA(1 << 20);
+    vector<char> bufferB(1 << 20);
+    while (fa && fb)
+    {
+        fa.read(bufferA.data(), bufferA.size());
+        fb.read(bufferB.data(), bufferB.size());
+        if (fa.gcount() != fb.gcount() || memcmp(bufferA.data(), bufferB.data(), static_cast<size_t>(fa.gcount())) != 0)
+        {
+            return false;
+        }
+    }
+    return fa.eof() && fb.eof();
+}
+
+//
+// Turns one run into rows: one per printed stage plus the total
+//
+void addRows(vector<Row>& rows, const string& corpus, uint64_t size, const string& program, int threads, const RunResult& run, double ratio, bool ok)
+{
+    vector<pair<string, double>> stages = run.stages;
+    stages.push_back({"total", run.wallMs});
+    for (const auto& [stage, ms] : stages)
+    {
+        double mbPerSec = (ms > 0) ? (size / 1e6) / (ms / 1e3) : 0.0;
+        rows.push_back({corpus, size, program, threads, stage, ms, mbPerSec, 0.0, ratio, run.peakRssKb, ok});
+    }
+}
+
+//
+// Fills in each row's speedup against the 1-thread run of the same corpus, program and stage
+//
+void computeSpeedups(vector<Row>& rows)
+{
+    map<string, double> baseline;
+    auto key = [](const Row& row) { return row.corpus + "|" + to_string(row.size) + "|" + row.program + "|" + row.stage; };
+    for (const Row& row : rows)
+    {
+        if (row.threads == 1)
+        {
+            baseline[key(row)] = row.ms;
+        }
+    }
+    for (Row& row : rows)
+    {
+        auto found = baseline.find(key(row));
+        if (found != baseline.end() && row.ms > 0)
+        {
+            row.speedup = found->second / row.ms;
+        }
+    }
+}
+
+//
+// Prints the rows as CSV or JSON
+//
+void printRows(const vector<Row>& rows, const string& format)
+{
+    if (format == "csv")
+    {
+        cout << "corpus,size,program,threads,stage,ms,mb_per_s,speedup,ratio,peak_rss_kb,ok" << endl;
+        for (const Row& row : rows)
+        {
+            cout << row.corpus << "," << row.size << "," << row.program << "," << row.threads << "," << row.stage << ","
+                 << row.ms << "," << row.mbPerSec << "," << row.speedup << "," << row.ratio << "," << row.peakRssKb << ","
+                 << (row.ok ? 1 : 0) << endl;
+        }
+        return;
+    }
+
+    cout << "[" << endl;
+    for (size_t i = 0; i < rows.size(); i++)
+    {
+        const Row& row = rows[i];
+        cout << "  {\"corpus\": \"" << row.corpus << "\", \"size\": " << row.size << ", \"program\": \"" << row.program
+             << "\", \"threads\": " << row.threads << ", \"stage\": \"" << row.stage << "\", \"ms\": " << row.ms
+             << ", \"mb_per_s\": " << row.mbPerSec << ", \"speedup\": " << row.speedup << ", \"ratio\": " << row.ratio
+             << ", \"peak_rss_kb\": " << row.peakRssKb << ", \"ok\": " << (row.ok ? "true" : "false") << "}"
+             << (i + 1 < rows.size() ? "," : "") << endl;
+    }
+    cout << "]" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    // 1) Read command line arguments
+    Options options;
+    if (readArgs(argc, argv, options) != 0)
+    {
+        return 1;
+    }
+    namespace fs = std::filesystem;
+    string encodeSequential = fs::absolute(fs::path(options.repoDir) / "encode-sequential" / "hc").string();
+    string encodeParallel = fs::absolute(fs::path(options.repoDir) / "encode-parallel" / "hc").string();
+    string decode = fs::absolute(fs::path(options.repoDir) / "decode" / "hc").string();
+    for (const string& program : {encodeSequential, encodeParallel, decode})
+    {
+        if (access(program.c_str(), X_OK) != 0)
+        {
+            cerr << endl;
+            cerr << "Error: " << program << " is missing, run make in its directory first!" << endl;
+            cerr << endl;
+            return 1;
+        }
+    }
+    string workDir = fs::absolute(fs::path(options.corpusDir) / "work").string();
+    fs::create_directories(workDir);
+    string encoded = workDir + "/encoded_output.bin";
+    string decoded = workDir + "/decoded_output.txt";
+
+    vector<Row> rows;
+    for (const string& kind : options.kinds)
+    {
+        for (uint64_t size : (kind == "tiny") ? TINY_SIZES : options.sizes)
+        {
+            // 2) Generate the input unless a previous run already did
+            string input = fs::absolute(fs::path(options.corpusDir) / (kind + "-" + to_string(size) + ".dat")).string();
+            if (!fs::exists(input) || fs::file_size(input) != size)
+            {
+                cerr << "Generating " << input << "..." << endl;
+                if (generateCorpus(kind, size, input) != 0)
+                {
+                    cerr << endl;
+                    cerr << "Error: Cannot write " << input << "!" << endl;
+                    cerr << endl;
+                    return 1;
+                }
+            }
+            cerr << "Benchmarking " << kind << " (" << size << " bytes)..." << endl;
+
+            // 3) encode-sequential, then decode its output with 1 thread
+            RunResult run = bestOf(options.repeat, {encodeSequential, input}, workDir);
+            double ratio = (run.ok && size > 0) ? static_cast<double>(fs::file_size(encoded)) / size : 0.0;
+            addRows(rows, kind, size, "encode-sequential", 1, run, ratio, run.ok);
+            if (run.ok)
+            {
+                RunResult decodeRun = bestOf(options.repeat, {decode, encoded, "1"}, workDir);
+                addRows(rows, kind, size, "decode-sequential", 1, decodeRun, ratio, decodeRun.ok && sameContents(decoded, input));
+            }
+
+            // 4) encode-parallel across the thread sweep, each decoded with as many threads
+            for (int threads : options.threads)
+            {
+                vector<string> args = {encodeParallel, input, to_string(threads)};
+                args.insert(args.end(), options.parallelArgs.begin(), options.parallelArgs.end());
+                run = bestOf(options.repeat, args, workDir);
+                ratio = (run.ok && size > 0) ? static_cast<double>(fs::file_size(encoded)) / size : 0.0;
+                addRows(rows, kind, size, "encode-parallel", threads, run, ratio, run.ok);
+                if (run.ok)
+                {
+                    RunResult decodeRun = bestOf(options.repeat, {decode, encoded, to_string(threads)}, workDir);
+                    addRows(rows, kind, size, "decode-parallel", threads, decodeRun, ratio, decodeRun.ok && sameContents(decoded, input));
+                }
+            }
+        }
+    }
+
+    // 5) Report
+    computeSpeedups(rows);
+    printRows(rows, options.format);
+    return 0;
+}
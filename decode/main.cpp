@@ -6,44 +6,142 @@
 // Aryaman C
 //
 
+#include <algorithm>
+#include <cctype>
 #include <chrono>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <string>
 #include <vector>
 
+#include <omp.h>
+
+#include "batch.h"
+#include "bitreader.h"
+#include "container.h"
+#include "decodetable.h"
 #include "huffman.h"
+#include "libhuffman.h"
+#include "mappedfile.h"
+#include "model.h"
+#include "outputwriter.h"
+#include "selfsync.h"
+#include "stats.h"
 
 using namespace std;
 using namespace std::chrono;
 
+// timings and counters, only collected with --stats
+static Stats stats;
+
+// batch mode: encoded files bigger than this are decoded one at a time with every thread
+static const uint64_t BATCH_LARGE_FILE = 1 << 20;
+
+//
+// Is this argument a plain number?
+//
+static bool isNumber(const char* text)
+{
+    if (*text == '\0')
+    {
+        return false;
+    }
+    for (; *text; text++)
+    {
+        if (!isdigit(static_cast<unsigned char>(*text)))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
 //
 // Reads the arguments from the command line
+// Files written by the current encoders carry their own code lengths; only legacy files need a tree.json
+// --stats=json or --stats=csv (anywhere on the line) prints timings and counters to stderr when done
+// --model <model.hcm> (anywhere on the line) is the shared model that files were encoded against, if they were
+// --batch <list.txt|dir> <outdir> decodes many files in one run (see decodeBatch), `outDir` is only set in batch mode
 //
-int readArgs(int argc, char* argv[], char*& tree, char*& binaryFile)
+int readArgs(int argc, char* argv[], char*& tree, char*& binaryFile, char*& outDir, int& numThreads, char*& modelFile, Stats::Format& statsFormat)
 {
-    if (argc != 3) 
+    // take out --stats=... and --model first, so the rest is positional
+    int kept = 1;
+    for (int i = 1; i < argc; i++)
+    {
+        if (string(argv[i]) == "--model" && i + 1 < argc)
+        {
+            modelFile = argv[++i];
+        }
+        else if (!Stats::isOption(argv[i], statsFormat))
+        {
+            argv[kept++] = argv[i];
+        }
+        else if (statsFormat == Stats::NONE)
+        {
+            cout << endl;
+            cout << "Error: --stats must be json or csv!" << endl;
+            cout << endl;
+            return 1;
+        }
+    }
+    argc = kept;
+
+    // <encoded.bin> [#threads] or <tree.json> <encoded.bin> [#threads] or --batch <list.txt|dir> <outdir> [#threads]
+    char* threadsArg = nullptr;
+    bool batch = (argc > 1 && string(argv[1]) == "--batch");
+    if (batch && (argc == 4 || argc == 5))
+    {
+        binaryFile = argv[2];
+        outDir = argv[3];
+        threadsArg = (argc == 5) ? argv[4] : nullptr;
+    }
+    else if (!batch && (argc == 2 || (argc == 3 && isNumber(argv[2]))))
+    {
+        binaryFile = argv[1];
+        threadsArg = (argc == 3) ? argv[2] : nullptr;
+    }
+    else if (!batch && (argc == 3 || argc == 4))
+    {
+        tree = argv[1];
+        binaryFile = argv[2];
+        threadsArg = (argc == 4) ? argv[3] : nullptr;
+    }
+    else
     {
         cout << endl;
-        cout << "Usage: " << argv[0] << " <tree.json> <encoded.bin> <output.txt>" << endl;;
+        cout << "Usage: " << argv[0] << " <encoded.bin> [#threads] [--model <model.hcm>] [--stats=json|csv]" << endl;
+        cout << "   or: " << argv[0] << " <tree.json> <encoded.bin> [#threads] [--stats=json|csv]   (files from older encoders)" << endl;
+        cout << "   or: " << argv[0] << " --batch <list.txt|dir> <outdir> [#threads] [--model <model.hcm>] [--stats=json|csv]" << endl;
         cout << endl;
         return 1;
     }
 
-    tree = argv[1];
-    binaryFile = argv[2];
+    if (threadsArg)
+    {
+        numThreads = atoi(threadsArg);
+        if (numThreads < 1)
+        {
+            cout << endl;
+            cout << "Error: #threads must be at least 1!" << endl;
+            cout << endl;
+            return 1;
+        }
+    }
     return 0;
 }
 
 //
 // Reads the Huffman tree from a JSON file
-// Credit to the answer in https://stackoverflow.com/questions/32205981/reading-json-files-in-c
+// The file is memory-mapped and parsed in place in a single pass
 //
-int readTree(char* treeFile, HuffmanNode*& root)
+int readTree(char* treeFile, HuffmanTree& tree)
 {
     // open file
-    ifstream jsonIn(treeFile, ifstream::binary);
-    if (!jsonIn) 
+    MappedFile jsonIn;
+    if (jsonIn.open(treeFile) != 0) 
     {
         cout << endl;
         cout << "Error: Cannot open tree JSON file!" << endl;
@@ -54,8 +152,7 @@ int readTree(char* treeFile, HuffmanNode*& root)
     // parse tree
     try
     {
-        root = readTreeJson(jsonIn);
-        jsonIn.close();
+        readTreeJson(reinterpret_cast<const char*>(jsonIn.data()), jsonIn.size(), tree);
     }
     catch (const std::exception& e)
     {
@@ -69,13 +166,13 @@ int readTree(char* treeFile, HuffmanNode*& root)
 }
 
 //
-// Reads the binary file
+// Maps the binary file
+// The file is memory-mapped, so the encoded bits are decoded in place rather than copied
 //
-int readBinaryFile(char* binaryFile, uint64_t& totalBits, vector<unsigned char>& byteBuffer, string& bitString)
+int readBinaryFile(char* binaryFile, MappedFile& file)
 {
     // open file
-    ifstream binaryIn(binaryFile, ifstream::binary);
-    if (!binaryIn)
+    if (file.open(binaryFile) != 0)
     {
         cout << endl;
         cout << "Error: Cannot open binary file!" << endl;
@@ -83,58 +180,125 @@ int readBinaryFile(char* binaryFile, uint64_t& totalBits, vector<unsigned char>&
         return 1;
     }
 
+    // every format starts with at least a 64-bit header
+    if (file.size() < sizeof(uint64_t))
+    {
+        cout << endl;
+        cout << "Error: Failed to read encoded data!" << endl;
+        cout << endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+//
+// Records how a self-synchronized decode went (see selfsync.h) for --stats
+//
+static void recordSync(const vector<SyncChunk>& chunks)
+{
+    size_t fallbacks = count_if(chunks.begin(), chunks.end(), [](const SyncChunk& chunk) { return !chunk.synced; });
+    stats.setCounter("sync_chunks", chunks.size());
+    stats.setCounter("sync_fallbacks", fallbacks);
+}
+
+//
+// Decodes a single-bitstream file (a 64-bit bit count followed by the bits)
+// With several threads the stream is split up and decoded with self-synchronization
+// With one, it is decoded straight into the output's chunks, each written out in the background while the next one fills
+//
+int decodeStream(char* outFileName, const DecodeTable& table, const MappedFile& file, int numThreads) 
+{
     // binary files begin with a 64-bit integer indicating the total number of bits
-    binaryIn.read(reinterpret_cast<char*>(&totalBits), sizeof(totalBits));
+    uint64_t totalBits;
+    memcpy(&totalBits, file.data(), sizeof(totalBits));
 
     // remaining data is encoded bits
-    // Credit to the question in https://stackoverflow.com/questions/5420317/reading-and-writing-binary-file
-    binaryIn.seekg(0, ios::end);
-    auto fileSize = binaryIn.tellg();
-    binaryIn.seekg(sizeof(totalBits), ios::beg);
-    
-    // reserve space
-    size_t dataBytes = static_cast<size_t>(fileSize) - sizeof(totalBits);
-    byteBuffer.resize(dataBytes);
-    
-    // read data
-    if (dataBytes > 0) 
-    {
-        binaryIn.read(reinterpret_cast<char*>(byteBuffer.data()), dataBytes);
-        if (binaryIn.fail()) 
+    size_t dataBytes = file.size() - sizeof(totalBits);
+    if (totalBits > static_cast<uint64_t>(dataBytes) * 8)
+    {
+        cout << endl;
+        cout << "Error: Binary file is truncated!" << endl;
+        cout << endl;
+        return 1;
+    }
+
+    // open file
+    OutputWriter outFile;
+    if (outFile.open(outFileName, numThreads == 1) != 0) 
+    {
+        cout << endl;
+        cout << "Error: Cannot open output file! " << endl;
+        cout << endl;
+        return 1;
+    }
+
+    // several threads: decode the chunks, then write them out in order
+    if (numThreads > 1)
+    {
+        vector<SyncChunk> chunks;
+        decodeSelfSync(table, file.data() + sizeof(totalBits), dataBytes, totalBits, numThreads, chunks);
+        recordSync(chunks);
+        for (const SyncChunk& chunk : chunks)
         {
-            cout << endl;
-            cout << "Error: Failed to read encoded data!" << endl;
-            cout << endl;
-            return 1;
+            outFile.write(chunk.prefix.data(), chunk.prefix.size());
+            outFile.write(chunk.symbols.data() + chunk.syncIndex, chunk.symbols.size() - chunk.syncIndex);
         }
-        binaryIn.close();
     }
 
-    // convert to bits
-    bitString.reserve(static_cast<size_t>(totalBits));
-    uint64_t bitsRead = 0;
-    for (size_t i = 0; i < byteBuffer.size() && bitsRead < totalBits; i++) 
+    // one thread: decode into the writer's free space until the bits run out
+    else
     {
-        unsigned char byte = byteBuffer[i];
-        for (int b = 7; b >= 0 && bitsRead < totalBits; b--) 
+        BitReader reader(file.data() + sizeof(totalBits), dataBytes, totalBits);
+        size_t decoded;
+        while ((decoded = table.decode(reader, outFile.space(), outFile.spaceLeft())) > 0) 
         {
-            bool bit = (byte >> b) & 1;
-            bitString.push_back(bit ? '1' : '0');
-            bitsRead++;
+            outFile.commit(decoded);
         }
     }
 
+    if (outFile.close() != 0)
+    {
+        cout << endl;
+        cout << "Error: Failed to write output file!" << endl;
+        cout << endl;
+        return 1;
+    }
     return 0;
 }
 
 //
-// Decodes the bits using the Huffman tree
+// Decodes the only block of a single-bitstream container on several threads, returns the number of symbols decoded
 //
-int decodeBits(char* outFileName, HuffmanNode* root, const string& bitString) 
+static size_t decodeSingleBlock(const DecodeTable& table, const unsigned char* payload, size_t payloadBytes, uint64_t totalBits, int numThreads, unsigned char* out, size_t length)
 {
-    // open file
-    ofstream outFile(outFileName, ifstream::binary);
-    if (!outFile) 
+    vector<SyncChunk> chunks;
+    size_t decoded = decodeSelfSync(table, payload, payloadBytes, totalBits, numThreads, out, length, chunks);
+    recordSync(chunks);
+    return decoded;
+}
+
+//
+// Decodes a container, splitting the blocks across threads
+// Each block is decoded straight into its place in the (memory-mapped) output file, with `table` or, in an
+// adaptive container, with the table in `blockTables` that it picked
+// A container with a single plain block is split up and decoded with self-synchronization instead
+//
+int decodeBlocks(const char* outFileName, const DecodeTable& table, const BlockTables& blockTables, const MappedFile& file, const ContainerHeader& header, const vector<BlockEntry>& blocks, size_t payloadOffset, int numThreads) 
+{
+    const unsigned char* payload = file.data() + payloadOffset;
+    size_t payloadBytes = file.size() - payloadOffset;
+
+    // where each block lands in the output
+    vector<uint64_t> outOffsets(blocks.size() + 1, 0);
+    for (size_t i = 0; i < blocks.size(); i++)
+    {
+        outOffsets[i + 1] = outOffsets[i] + blocks[i].decodedLength;
+    }
+
+    // open file, already sized to hold everything
+    MappedFile outFile;
+    if (outFile.create(outFileName, static_cast<size_t>(outOffsets.back())) != 0) 
     {
         cout << endl;
         cout << "Error: Cannot open output file! " << endl;
@@ -142,62 +306,338 @@ int decodeBits(char* outFileName, HuffmanNode* root, const string& bitString)
         return 1;
     }
 
-    // decode bit string using Huffman tree
-    HuffmanNode* node = root;
-    for (char bitChar : bitString) 
+    // one plain block: split it up within
+    if (blocks.size() == 1 && blocks[0].bitOffset == 0 && !(header.flags & (FLAG_INTERLEAVED | FLAG_ADAPTIVE)) && numThreads > 1)
     {
-        if (!node) break;
-
-        if (bitChar == '0') // go left = 0
+        size_t decoded = decodeSingleBlock(table, payload, payloadBytes, header.totalBits, numThreads, outFile.writableData(), blocks[0].decodedLength);
+        if (decoded != blocks[0].decodedLength)
         {
-            node = node->left;
-        } 
-        else // go right = 1
-        {
-            node = node->right;
+            cout << endl;
+            cout << "Error: Block ended before all of its symbols were decoded!" << endl;
+            cout << endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    // blocks are independent, so threads just grab the next one
+    bool corrupt = false;
+    ThreadWork* work = stats.beginRegion("decode", numThreads);
+    #pragma omp parallel for schedule(dynamic) num_threads(numThreads)
+    for (size_t i = 0; i < blocks.size(); i++) {
+        uint64_t start = work ? Stats::now() : 0;
+        size_t decoded = (header.flags & FLAG_ADAPTIVE)
+            ? decodeAdaptiveBlock(blockTables, payload, payloadBytes, header, blocks, i, outFile.writableData() + outOffsets[i])
+            : decodeBlock(table, payload, payloadBytes, header, blocks, i, outFile.writableData() + outOffsets[i]);
+        if (decoded != blocks[i].decodedLength) {
+            #pragma omp atomic write
+            corrupt = true;
         }
-        // hit leaf, so output character and reset to root
-        if (node && !node->left && !node->right) {
-            outFile.put(node->ch);
-            node = root;
+        if (work) {
+            work[omp_get_thread_num()].add(Stats::now() - start, decoded);
         }
     }
+    if (corrupt)
+    {
+        cout << endl;
+        cout << "Error: Block ended before all of its symbols were decoded!" << endl;
+        cout << endl;
+        return 1;
+    }
 
-    outFile.close();
     return 0;
 }
 
+/// <summary>
+/// BatchScratch holds one thread's buffers in batch mode: the file it is
+/// working on, the decoded bytes, and a Decoder (which keeps its decode
+/// table, and that of the shared model). They are reused from one file to
+/// the next, so after the first few files a thread stops allocating.
+/// </summary>
+struct BatchScratch {
+    explicit BatchScratch(const Model* model)
+        : decoder(1, model) {}
+
+    vector<unsigned char> input;
+    vector<uint8_t> output;
+    Decoder decoder;
+};
+
+//
+// Decodes one small file of a batch on the calling thread, using that thread's scratch buffers
+// Only containers can be decoded in a batch, older files need their own tree.json
+//
+int decodeBatchFile(const BatchFile& file, BatchScratch& scratch)
+{
+    // read the whole file into the scratch buffer
+    ifstream infile(file.input, ifstream::binary);
+    scratch.input.resize(file.size);
+    if (!infile || (file.size > 0 && !infile.read(reinterpret_cast<char*>(scratch.input.data()), file.size)))
+    {
+        return 1;
+    }
+
+    if (scratch.decoder.decode(scratch.input, scratch.output) != 0)
+    {
+        return 1;
+    }
+    return OutputWriter::writeFile(file.output.c_str(), scratch.output.data(), scratch.output.size());
+}
+
+//
+// Decodes one large file of a batch with every thread, as a normal run would
+// A file encoded against the shared model is decoded with `modelTable`, built once for the whole batch
+//
+int decodeLargeBatchFile(const BatchFile& file, int numThreads, const Model* model, const DecodeTable& modelTable)
+{
+    MappedFile encodedFile;
+    ContainerHeader header = {};
+    uint8_t codeLengths[256] = {};
+    uint64_t modelId = 0;
+    vector<BlockEntry> blocks;
+    BlockCodings codings;
+    size_t payloadOffset = 0;
+    DecodeTable table;
+    BlockTables blockTables;
+    if (encodedFile.open(file.input.c_str()) != 0
+        || !isContainer(encodedFile.data(), encodedFile.size())
+        || readContainerHeader(encodedFile.data(), encodedFile.size(), header, codeLengths, modelId, blocks, codings, payloadOffset) != 0
+        || header.version < 2 || useModel(header, modelId, model, codeLengths) != 0)
+    {
+        return 1;
+    }
+    bool shared = (header.flags & FLAG_SHARED_MODEL);
+    if ((header.flags & FLAG_ADAPTIVE) ? blockTables.build(codings) != 0 : !shared && table.buildCanonical(codeLengths) != 0)
+    {
+        return 1;
+    }
+    return decodeBlocks(file.output.c_str(), shared ? modelTable : table, blockTables, encodedFile, header, blocks, payloadOffset, numThreads);
+}
+
+//
+// Decodes every file of a batch in one process, returns the number of files that failed
+// Large files are decoded first, one after another, each with every thread (across its blocks, or
+// resynchronized within a single bitstream). The rest go whole to whichever thread is free next, largest first
+//
+size_t decodeBatch(const vector<BatchFile>& files, int numThreads, const Model* model)
+{
+    vector<size_t> large;
+    vector<size_t> small;
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        (files[i].size > BATCH_LARGE_FILE ? large : small).push_back(i);
+    }
+    sort(small.begin(), small.end(), [&](size_t a, size_t b) { return files[a].size > files[b].size; });
+
+    // the shared model's table is the same for every large file (the small ones get it through their Decoder)
+    DecodeTable modelTable;
+    if (model && !large.empty())
+    {
+        modelTable.buildCanonical(model->codeLengths);
+    }
+
+    vector<char> failed(files.size(), 0);
+    for (size_t i : large)
+    {
+        failed[i] = (decodeLargeBatchFile(files[i], numThreads, model, modelTable) != 0);
+    }
+
+    vector<BatchScratch> scratch;
+    for (int t = 0; t < numThreads; t++)
+    {
+        scratch.emplace_back(model);
+    }
+    ThreadWork* work = stats.beginRegion("batch", numThreads);
+    #pragma omp parallel for schedule(dynamic) num_threads(numThreads)
+    for (size_t k = 0; k < small.size(); k++) {
+        int tid = omp_get_thread_num();
+        uint64_t start = work ? Stats::now() : 0;
+        const BatchFile& file = files[small[k]];
+        failed[small[k]] = (decodeBatchFile(file, scratch[tid]) != 0);
+        if (work) {
+            work[tid].add(Stats::now() - start, file.size);
+        }
+    }
+
+    // say which files failed, now that the threads are done
+    size_t failures = 0;
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        if (failed[i])
+        {
+            cout << endl;
+            cout << "Error: Cannot decode " << files[i].input << " to " << files[i].output << "!" << endl;
+            cout << endl;
+            failures++;
+        }
+    }
+    return failures;
+}
+
+//
+// Runs a whole batch: lists the files, decodes them and reports the totals
+// Each name.bin is decoded to name in the output directory (any other name gets .out added)
+//
+int runBatch(const char* batchList, const char* outDir, int numThreads, const Model* model)
+{
+    auto list_start = high_resolution_clock::now();
+    vector<BatchFile> files;
+    if (listBatch(batchList, outDir, ".bin", ".out", files) != 0)
+    {
+        return 1;
+    }
+    auto list_end = high_resolution_clock::now();
+    cout << "Listed " << files.size() << " files in " << duration_cast<milliseconds>(list_end - list_start).count() << " ms..." << endl;
+    stats.addStage("list", list_end - list_start);
+
+    auto decode_start = high_resolution_clock::now();
+    size_t failures = decodeBatch(files, numThreads, model);
+    auto decode_end = high_resolution_clock::now();
+    cout << "Decoded files in " << duration_cast<milliseconds>(decode_end - decode_start).count() << " ms..." << endl;
+    stats.addStage("decode", decode_end - decode_start);
+
+    if (stats.enabled())
+    {
+        uint64_t inputBytes = 0;
+        for (const BatchFile& file : files)
+        {
+            inputBytes += file.size;
+        }
+        stats.setCounter("files", files.size());
+        stats.setCounter("failed_files", failures);
+        stats.setCounter("input_bytes", inputBytes);
+        stats.setCounter("threads", numThreads);
+        stats.print(cerr);
+    }
+    return (failures == 0) ? 0 : 1;
+}
+
 int main(int argc, char* argv[]) {
     // 1) Read command line arguments (returns default file "decoded_output.txt")
     char* decodeTree = nullptr;
     char* encodedBin = nullptr;
     char* outputFileName = "decoded_output.txt";
-    if (readArgs(argc, argv, decodeTree, encodedBin) != 0) {
+    char* batchOutDir = nullptr; // default one file, not a batch
+    int numThreads = 1; // default 1 thread
+    char* modelFile = nullptr; // default no shared model
+    Stats::Format statsFormat = Stats::NONE; // default no stats
+    if (readArgs(argc, argv, decodeTree, encodedBin, batchOutDir, numThreads, modelFile, statsFormat) != 0) {
         return 1;
     }
+    stats.enable("decode", statsFormat);
     cout << "Read arguments..." << endl;
 
-    // 2) Read Huffman tree
-    HuffmanNode* root = nullptr;
-    if (readTree(decodeTree, root) != 0) {
-        return 1;
+    // a shared model is read once, up front
+    Model model;
+    const Model* sharedModel = nullptr;
+    if (modelFile) {
+        auto model_start = high_resolution_clock::now();
+        if (readModel(modelFile, model) != 0) {
+            cout << endl;
+            cout << "Error: Cannot read model file, or it is not a model!" << endl;
+            cout << endl;
+            return 1;
+        }
+        sharedModel = &model;
+        auto model_end = high_resolution_clock::now();
+        cout << "Read model in " << duration_cast<milliseconds>(model_end - model_start).count() << " ms..." << endl;
+        stats.addStage("model", model_end - model_start);
     }
-    cout << "Read Huffman tree..." << endl;
 
-    // 3) Read binary file
-    uint64_t totalBits;
-    vector<unsigned char> byteBuffer;
-    string bitString;
-    if (readBinaryFile(encodedBin, totalBits, byteBuffer, bitString) != 0) {
+    // batch mode runs every file through its own loop
+    if (batchOutDir) {
+        return runBatch(encodedBin, batchOutDir, numThreads, sharedModel);
+    }
+
+    // 2) Map binary file, and read the container header if it has one
+    auto read_start = high_resolution_clock::now();
+    MappedFile encodedFile;
+    if (readBinaryFile(encodedBin, encodedFile) != 0) {
         return 1;
     }
-    cout << "Read binary file..." << endl;
+    bool container = isContainer(encodedFile.data(), encodedFile.size());
+    ContainerHeader header = {};
+    uint8_t codeLengths[256] = {};
+    uint64_t modelId = 0;
+    vector<BlockEntry> blocks;
+    BlockCodings codings;
+    size_t payloadOffset = 0;
+    if (container && readContainerHeader(encodedFile.data(), encodedFile.size(), header, codeLengths, modelId, blocks, codings, payloadOffset) != 0) {
+        cout << endl;
+        cout << "Error: Corrupt or unsupported binary file header!" << endl;
+        cout << endl;
+        return 1;
+    }
+    if (container && useModel(header, modelId, sharedModel, codeLengths) != 0) {
+        cout << endl;
+        cout << "Error: This binary file was encoded against a shared model, pass that model with --model!" << endl;
+        cout << endl;
+        return 1;
+    }
+    auto read_end = high_resolution_clock::now();
+    cout << "Read binary file in " << duration_cast<milliseconds>(read_end - read_start).count() << " ms..." << endl;
+    stats.addStage("read", read_end - read_start);
 
-    // 4) Decode bits using Huffman tree
-    if (decodeBits(outputFileName, root, bitString) != 0) {
+    // 3) Build decode tables, from the code lengths in the header (the shared model's, or one set per table of an
+    //    adaptive container) or from a legacy tree.json
+    auto table_start = high_resolution_clock::now();
+    DecodeTable table;
+    BlockTables blockTables;
+    if (decodeTree) {
+        HuffmanTree tree;
+        if (readTree(decodeTree, tree) != 0) {
+            return 1;
+        }
+        cout << "Read Huffman tree..." << endl;
+        if (table.buildFromTree(tree) != 0) {
+            cout << endl;
+            cout << "Error: Huffman tree is too deep!" << endl;
+            cout << endl;
+            return 1;
+        }
+    }
+    else if (container && header.version >= 2) {
+        if ((header.flags & FLAG_ADAPTIVE) ? blockTables.build(codings) != 0 : table.buildCanonical(codeLengths) != 0) {
+            cout << endl;
+            cout << "Error: Invalid code lengths in binary file!" << endl;
+            cout << endl;
+            return 1;
+        }
+    }
+    else {
+        cout << endl;
+        cout << "Error: This binary file was written by an older encoder, pass its tree.json too!" << endl;
+        cout << endl;
         return 1;
     }
-    cout << "Decoded bits to decoded_output.txt..." << endl;
+    auto table_end = high_resolution_clock::now();
+    cout << "Built decode table in " << duration_cast<milliseconds>(table_end - table_start).count() << " ms..." << endl;
+    stats.addStage("table", table_end - table_start);
+
+    // 4) Decode bits using the decode table, straight from the mapped bytes
+    auto decode_start = high_resolution_clock::now();
+    if (container) {
+        if (decodeBlocks(outputFileName, table, blockTables, encodedFile, header, blocks, payloadOffset, numThreads) != 0) {
+            return 1;
+        }
+    }
+    else {
+        if (decodeStream(outputFileName, table, encodedFile, numThreads) != 0) {
+            return 1;
+        }
+    }
+    auto decode_end = high_resolution_clock::now();
+    cout << "Decoded bits in " << duration_cast<milliseconds>(decode_end - decode_start).count() << " ms to decoded_output.txt..." << endl;
+    stats.addStage("decode", decode_end - decode_start);
+
+    // 5) Print timings and counters (only with --stats)
+    if (stats.enabled()) {
+        stats.setCounter("input_bytes", encodedFile.size());
+        stats.setCounter("output_bytes", std::filesystem::file_size(outputFileName));
+        stats.setCounter("blocks", blocks.size());
+        stats.setCounter("threads", numThreads);
+        stats.print(cerr);
+    }
 
     // done
     return 0;
@@ -6,45 +6,216 @@
 // Aryaman C
 //
 
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <chrono>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <string>
-#include <sstream>
-#include <unordered_map>
+#include <thread>
 #include <vector>
 
 #include <omp.h>
 
+#include "adaptive.h"
+#include "batch.h"
+#include "bitwriter.h"
+#include "container.h"
+#include "histogram.h"
 #include "huffman.h"
+#include "libhuffman.h"
+#include "mappedfile.h"
+#include "model.h"
+#include "options.h"
+#include "outputwriter.h"
+#include "spscqueue.h"
+#include "stats.h"
 
 using namespace std;
 using namespace std::chrono;
 
+// streaming mode reads this much per call in the counting pass, with this many buffers read ahead of the count
+static const size_t STREAM_BUFFER_SIZE = 1 << 20;
+static const size_t STREAM_BUFFERS = 4;
+
+// the encode pipeline keeps this many claims in flight per worker (one being encoded, one read or written),
+// where a worker claims small blocks up to PIPELINE_CLAIM_BLOCKS at a time (SCHEDULE_CHUNK_SIZE worth)
+static const size_t PIPELINE_DEPTH = 2;
+static const size_t PIPELINE_CLAIM_BLOCKS = 64;
+
+// the histogram and the single-stream encode deal the input out in chunks of this size, so a thread that
+// gets descheduled or shares its core with another just takes fewer of them
+static const size_t SCHEDULE_CHUNK_SIZE = 256 << 10;
+
+// with #threads left to auto, every thread gets at least this much of the input
+static const uint64_t AUTO_BYTES_PER_THREAD = 1 << 20;
+
+// streaming and interleaved modes encode blocks of this size unless --block-size says otherwise
+static const uint64_t DEFAULT_BLOCK_SIZE = 1 << 20;
+
+// timings and counters, only collected with --stats
+static Stats stats;
+
 //
 // Reads the arguments from the command line
+// A block size of 0 means the whole file is written as one continuous bitstream
+// --max-code-length caps how long any code may get (1 to 64 bits)
+// --stats=json or --stats=csv prints timings and counters to stderr when done
+// --populate and --huge-pages are hints for mapping the input (see MappedFile)
+// --stream encodes in two passes over the file without ever holding all of it, a few blocks per thread at a time
+// --interleave codes every block as INTERLEAVED_STREAMS interleaved streams
+// --adaptive gives every block the cheapest of the table before it, a table of its own, or no coding at all (see adaptive.h),
+// which takes blocks of at least MIN_ADAPTIVE_BLOCK_SIZE
+// --model <model.hcm> encodes against a shared model instead of the input's own codes (see model.h)
+// --min-saving <percent> is how much smaller than the input coding has to make it, or it is stored as it is (see storeInstead)
+// --batch <list.txt|dir> <outdir> takes the place of <input.txt> and encodes many files in one run (see encodeBatch)
+// --train <list.txt|dir> <model.hcm> takes its place to train a shared model on sample files instead (see runTrain)
+// `outPath` is the output directory or model file in those modes, and only set then
+// #threads may be auto or left out, which gives `numThreads` 0 (see autoThreads)
 //
-int readArgs(int argc, char* argv[], char*& inputFile, int& numThreads)
+int readArgs(int argc, char* argv[], char*& inputFile, char*& outPath, bool& training, int& numThreads, uint64_t& blockSize, bool& streaming, bool& interleaved, bool& adaptive, double& minSaving, int& mapHints, int& maxCodeLength, char*& modelFile, Stats::Format& statsFormat)
 {
-    if (argc != 3)
+    // batch and training modes have two more arguments in front of #threads
+    string mode = (argc > 1) ? argv[1] : "";
+    bool batch = (mode == "--batch");
+    training = (mode == "--train");
+    int threadsArg = (batch || training) ? 4 : 2;
+    bool valid = (argc >= threadsArg);
+    bool threadsGiven = (argc > threadsArg && string(argv[threadsArg]).rfind("--", 0) != 0);
+    for (int i = threadsGiven ? threadsArg + 1 : threadsArg; valid && i < argc; i++)
+    {
+        string option = argv[i];
+        if (option == "--stream")
+        {
+            streaming = true;
+        }
+        else if (option == "--interleave")
+        {
+            interleaved = true;
+        }
+        else if (option == "--adaptive")
+        {
+            adaptive = true;
+        }
+        else if (option == "--max-code-length" && i + 1 < argc)
+        {
+            maxCodeLength = atoi(argv[++i]);
+            valid = (maxCodeLength >= 1 && maxCodeLength <= MAX_CODE_LENGTH);
+        }
+        else if (option == "--model" && i + 1 < argc)
+        {
+            modelFile = argv[++i];
+        }
+        else if (option == "--min-saving" && i + 1 < argc)
+        {
+            valid = (parsePercent(argv[++i], minSaving) == 0);
+        }
+        else if (Stats::isOption(option, statsFormat))
+        {
+            valid = (statsFormat != Stats::NONE);
+        }
+        else if (option == "--populate")
+        {
+            mapHints |= MappedFile::POPULATE;
+        }
+        else if (option == "--huge-pages")
+        {
+            mapHints |= MappedFile::HUGE_PAGES;
+        }
+        else if (option == "--block-size" && i + 1 < argc && parseSize(argv[i + 1], blockSize) == 0 && blockSize > 0)
+        {
+            i++;
+        }
+        else
+        {
+            valid = false;
+        }
+    }
+
+    // a model fixes the code lengths, adaptive blocks are planned with the whole input at hand, training only takes the length cap
+    valid = valid && !(modelFile && (maxCodeLength > 0 || adaptive));
+    valid = valid && !(adaptive && streaming);
+    valid = valid && !(batch && (streaming || mapHints != 0));
+    valid = valid && !(training && (streaming || interleaved || adaptive || mapHints != 0 || blockSize > 0 || modelFile));
+    if (!valid)
+    {
+        cout << endl;
+        cout << "Usage: " << argv[0] << " = <input.txt> [<#threads> | auto] [--block-size <bytes, e.g. 1M>] [--stream | --adaptive] [--interleave] [--max-code-length <bits> | --model <model.hcm>] [--min-saving <percent, e.g. 1>] [--populate] [--huge-pages] [--stats=json|csv]" << endl;
+        cout << "   or: " << argv[0] << " --batch <list.txt|dir> <outdir> [<#threads> | auto] [--block-size <bytes, e.g. 1M>] [--adaptive] [--interleave] [--max-code-length <bits> | --model <model.hcm>] [--min-saving <percent, e.g. 1>] [--stats=json|csv]" << endl;
+        cout << "   or: " << argv[0] << " --train <list.txt|dir> <model.hcm> [<#threads> | auto] [--max-code-length <bits>] [--stats=json|csv]" << endl;
+        cout << endl;
+        return 1;
+    }
+
+    if (adaptive && blockSize > 0 && blockSize < MIN_ADAPTIVE_BLOCK_SIZE)
     {
         cout << endl;
-        cout << "Usage: " << argv[0] << " = <input.txt> <#threads>" << endl;;
+        cout << "Error: Adaptive blocks must be at least " << MIN_ADAPTIVE_BLOCK_SIZE << " bytes!" << endl;
         cout << endl;
         return 1;
     }
 
-    inputFile = argv[1];
-    numThreads = atoi(argv[2]);
+    inputFile = (threadsArg == 4) ? argv[2] : argv[1];
+    outPath = (threadsArg == 4) ? argv[3] : nullptr;
+    if (!threadsGiven || string(argv[threadsArg]) == "auto")
+    {
+        numThreads = 0;
+        return 0;
+    }
+    numThreads = atoi(argv[threadsArg]);
+    if (numThreads < 1)
+    {
+        cout << endl;
+        cout << "Error: #threads must be at least 1!" << endl;
+        cout << endl;
+        return 1;
+    }
     return 0;
 }
 
 //
-// Reads the input file
+// Picks the thread count when #threads is auto: one per core this process may run on, but only as many as
+// the input has AUTO_BYTES_PER_THREAD for (and at least one), so a small file does not start a thread per core
 //
-int readInputFile(const char* inputFileName, string& content)
+int autoThreads(uint64_t inputBytes)
+{
+    uint64_t wanted = max<uint64_t>(1, inputBytes / AUTO_BYTES_PER_THREAD);
+    return static_cast<int>(min<uint64_t>(omp_get_num_procs(), wanted));
+}
+
+//
+// How many threads a parallel region over `items` independent pieces should start: no more than it has pieces
+//
+static int regionThreads(int numThreads, size_t items)
+{
+    return static_cast<int>(max<size_t>(1, min<size_t>(numThreads, items)));
+}
+
+//
+// Maps the input file
+// The file is memory-mapped read-only, so the later stages read it in place rather than from a copy
+//
+int readInputFile(const char* inputFileName, MappedFile& input, int mapHints)
+{
+    // open file
+    if (input.open(inputFileName, mapHints) != 0) 
+    {
+        cout << endl;
+        cout << "Error: Cannot open .txt file!" << endl;
+        cout << endl;
+        return 1;
+    }
+    return 0;
+}
+
+//
+// Build frequency table by reading the input one buffer at a time (streaming mode)
+// A reader thread keeps up to STREAM_BUFFERS buffers read ahead, so the disk and the count overlap
+// Returns the number of bytes read, which the second pass encodes
+//
+int countInputFile(const char* inputFileName, uint64_t freqs[256], uint64_t& contentSize)
 {
     // open file
     ifstream infile(inputFileName, ifstream::binary);
@@ -56,55 +227,333 @@ int readInputFile(const char* inputFileName, string& content)
         return 1;
     }
 
-    // read entire file into string
-    ostringstream buffer;
-    buffer << infile.rdbuf();
-    content = buffer.str();
+    // reader: fill each free buffer and pass it on, until a short one says the file has ended
+    vector<vector<unsigned char>> buffers(STREAM_BUFFERS, vector<unsigned char>(STREAM_BUFFER_SIZE));
+    vector<size_t> lengths(STREAM_BUFFERS, 0);
+    SpscQueue<size_t> freeBuffers(STREAM_BUFFERS);
+    SpscQueue<size_t> fullBuffers(STREAM_BUFFERS);
+    for (size_t i = 0; i < STREAM_BUFFERS; i++) 
+    {
+        freeBuffers.push(i);
+    }
+    atomic<bool> abort(false); // never set: the count reads every buffer the reader passes on
+    thread reader([&]() {
+        size_t i = 0;
+        do {
+            freeBuffers.waitPop(i, abort);
+            infile.read(reinterpret_cast<char*>(buffers[i].data()), STREAM_BUFFER_SIZE);
+            lengths[i] = static_cast<size_t>(infile.gcount());
+            fullBuffers.waitPush(i, abort);
+        } while (lengths[i] == STREAM_BUFFER_SIZE);
+    });
+
+    // count each buffer as it comes in
+    fill(freqs, freqs + 256, 0);
+    contentSize = 0;
+    size_t got;
+    do 
+    {
+        size_t i = 0;
+        fullBuffers.waitPop(i, abort);
+        got = lengths[i];
+        countBytes(buffers[i].data(), got, freqs);
+        contentSize += got;
+        freeBuffers.push(i);
+    } while (got == STREAM_BUFFER_SIZE);
+    reader.join();
+    if (infile.bad()) 
+    {
+        cout << endl;
+        cout << "Error: Failed to read .txt file!" << endl;
+        cout << endl;
+        return 1;
+    }
+
     infile.close();
     return 0;
 }
 
 //
-// Build Huffman tree, generate codes, and write to JSON
+// Build frequency table, the threads taking chunks of the input as they go (parallelized)
+//
+void countContent(const unsigned char* content, uint64_t contentSize, int numThreads, uint64_t freqs[256])
+{
+    size_t chunkCount = static_cast<size_t>((contentSize + SCHEDULE_CHUNK_SIZE - 1) / SCHEDULE_CHUNK_SIZE);
+    int threads = regionThreads(numThreads, chunkCount);
+    vector<Histogram> threadHistograms(threads);
+    ThreadWork* work = stats.beginRegion("histogram", threads);
+    #pragma omp parallel num_threads(threads)
+    {
+        // each thread counts its chunks into its own cache-line-aligned table
+        int tid = omp_get_thread_num();
+        Histogram& local = threadHistograms[tid];
+        fill(std::begin(local.counts), std::end(local.counts), 0);
+        #pragma omp for schedule(dynamic) nowait
+        for (size_t k = 0; k < chunkCount; ++k) {
+            size_t begin = k * SCHEDULE_CHUNK_SIZE;
+            size_t end = static_cast<size_t>(min<uint64_t>(contentSize, begin + SCHEDULE_CHUNK_SIZE));
+            uint64_t start = work ? Stats::now() : 0;
+            countBytes(content + begin, end - begin, local.counts);
+            if (work) {
+                work[tid].add(Stats::now() - start, end - begin);
+            }
+        }
+    }
+
+    // combine frequency tables from all threads
+    fill(freqs, freqs + 256, 0);
+    for (const auto& local : threadHistograms) {
+        for (int c = 0; c < 256; c++) {
+            freqs[c] += local.counts[c];
+        }
+    }
+}
+
+//
+// Build Huffman tree, then derive code lengths and canonical codes from it
+// The code lengths are all the decoder needs, they go into the header of the binary file
+// A tree deeper than `maxCodeLength` (or than MAX_CODE_LENGTH, if no limit was given) is replaced by
+// the best code lengths within the limit, and the cost of that is reported
+// Batch mode passes `quiet`, so threads working on different files do not print over each other
+//
+int buildHuffmanTree(const uint64_t freqs[256], int maxCodeLength, uint8_t codeLengths[256], CodeTable& codes, bool quiet = false)
+{
+    // build tree (an empty input has no tree and no codes)
+    HuffmanTree tree;
+    buildHuffmanTree(freqs, tree);
+    computeCodeLengths(tree, codeLengths);
+    if (tree.empty()) 
+    {
+        return 0;
+    }
+
+    // cap the code lengths if the tree is too deep
+    int limit = (maxCodeLength > 0) ? maxCodeLength : MAX_CODE_LENGTH;
+    if (*max_element(codeLengths, codeLengths + 256) > limit) 
+    {
+        uint64_t unrestrictedBits = countEncodedBits(freqs, codeLengths);
+        if (limitCodeLengths(freqs, limit, codeLengths) != 0) 
+        {
+            if (!quiet) 
+            {
+                cout << endl;
+                cout << "Error: Codes of at most " << limit << " bits cannot cover every byte in the input!" << endl;
+                cout << endl;
+            }
+            return 1;
+        }
+        uint64_t limitedBits = countEncodedBits(freqs, codeLengths);
+        if (!quiet) 
+        {
+            cout << "Limited codes to " << limit << " bits, encoded size +" << 100.0 * (limitedBits - unrestrictedBits) / unrestrictedBits << "% vs unrestricted..." << endl;
+        }
+    }
+    else if (maxCodeLength > 0 && !quiet) 
+    {
+        cout << "Codes already fit in " << limit << " bits, encoded size +0% vs unrestricted..." << endl;
+    }
+
+    // generate bit strings for each character
+    if (generateCodes(codeLengths, codes) != 0) 
+    {
+        if (!quiet) 
+        {
+            cout << endl;
+            cout << "Error: Huffman codes are longer than " << MAX_CODE_LENGTH << " bits!" << endl;
+            cout << endl;
+        }
+        return 1;
+    }
+    return 0;
+}
+
+//
+// Write out encoded bits to binary file
+// The file is a container holding the code lengths and the whole content as a single block
+// Credit to answer in https://stackoverflow.com/questions/8329767/writing-into-binary-files
 //
-int buildHuffmanTree(unordered_map<char, int>& freqMap, unordered_map<char, string>& codes, char* treeJsonName)
+int writeEncodedBits(const vector<unsigned char>& encoded, const uint8_t codeLengths[256], size_t contentSize, uint32_t flags, char* encodedBinName)
 {
-    // build tree
-    HuffmanNode* root = buildHuffmanTree(freqMap);
-    if (!root) 
+    // open file
+    OutputWriter binOut;
+    if (binOut.open(encodedBinName) != 0) 
     {
         cout << endl;
-        cout << "Error: Cannot build tree!" << endl;
+        cout << "Error: Cannot open binary file!" << endl;
         cout << endl;
         return 1;
     }
 
-    // generate bit strings for each character
-    generateCodes(root, "", codes);
+    // first, the header: code lengths and the one block (none for an empty input)
+    vector<BlockEntry> blocks;
+    if (contentSize > 0) 
+    {
+        blocks.push_back({0, static_cast<uint64_t>(contentSize)});
+    }
+    vector<unsigned char> header;
+    writeContainerHeader(header, contentSize, codeLengths, blocks, static_cast<uint64_t>(encoded.size()) * 8, flags);
+    binOut.write(header.data(), header.size());
+
+    // then the packed bytes, already padded with 0s to a whole byte (this is how we will also decode the binary file)
+    binOut.write(encoded.data(), encoded.size());
 
-    // write out
-    ofstream treeOut(treeJsonName, ifstream::binary);
-    if (!treeOut) 
+    if (binOut.close() != 0) 
     {
         cout << endl;
-        cout << "Error: Cannot write out!" << endl;
+        cout << "Error: Failed to write binary file!" << endl;
         cout << endl;
         return 1;
     }
-    writeTreeJson(root, treeOut);
-    treeOut.close();
     return 0;
 }
 
 //
-// Write out encoded bits to binary file
-// Credit to answer in https://stackoverflow.com/questions/8329767/writing-into-binary-files
+// Encode the content as one continuous bitstream (parallelized)
+// The content is cut into chunks that the threads take as they go. Pass one sums the code lengths
+// in each chunk, so a prefix sum gives every chunk the bit offset it starts at. Pass two writes
+// each chunk's packed bits straight to that offset in one shared buffer. Neighbouring chunks can
+// share a byte, so each one hands back its last partial byte and those are merged in at the end.
+//
+void encodeStream(const unsigned char* content, size_t contentSize, const CodeTable& codes, int numThreads, vector<unsigned char>& encoded, uint64_t& totalBits)
+{
+    size_t chunkCount = (contentSize + SCHEDULE_CHUNK_SIZE - 1) / SCHEDULE_CHUNK_SIZE;
+    int threads = regionThreads(numThreads, chunkCount);
+    vector<uint64_t> chunkOffsets(chunkCount + 1, 0);
+    vector<unsigned char> partialBytes(chunkCount, 0);
+    totalBits = 0;
+    encoded.clear();
+    ThreadWork* work = stats.beginRegion("encode", threads);
+    #pragma omp parallel num_threads(threads)
+    {
+        int tid = omp_get_thread_num();
+
+        // pass 1: how many bits does each chunk take?
+        #pragma omp for schedule(dynamic)
+        for (size_t k = 0; k < chunkCount; ++k) {
+            size_t begin = k * SCHEDULE_CHUNK_SIZE;
+            size_t end = min(contentSize, begin + SCHEDULE_CHUNK_SIZE);
+            uint64_t start = work ? Stats::now() : 0;
+            uint64_t chunkBits = 0;
+            for (size_t i = begin; i < end; ++i) {
+                chunkBits += codes[content[i]].length;
+            }
+            chunkOffsets[k + 1] = chunkBits;
+            if (work) {
+                work[tid].ns += Stats::now() - start;
+            }
+        }
+
+        // prefix sum gives each chunk its starting bit, then size the output once
+        #pragma omp single
+        {
+            for (size_t k = 0; k < chunkCount; ++k) {
+                chunkOffsets[k + 1] += chunkOffsets[k];
+            }
+            totalBits = chunkOffsets[chunkCount];
+            encoded.assign((totalBits + 7) / 8, 0);
+        }
+
+        // pass 2: write each chunk's bits at its final offset
+        #pragma omp for schedule(dynamic)
+        for (size_t k = 0; k < chunkCount; ++k) {
+            size_t begin = k * SCHEDULE_CHUNK_SIZE;
+            size_t end = min(contentSize, begin + SCHEDULE_CHUNK_SIZE);
+            uint64_t start = work ? Stats::now() : 0;
+            BitWriter localWriter(encoded.data(), chunkOffsets[k]);
+            for (size_t i = begin; i < end; ++i) {
+                const HuffmanCode& code = codes[content[i]];
+                localWriter.putBits(code.bits, code.length);
+            }
+            partialBytes[k] = localWriter.finishShared();
+            if (work) {
+                work[tid].add(Stats::now() - start, end - begin);
+            }
+        }
+    }
+
+    // merge each chunk's last partial byte into the byte it shares with the next chunk
+    for (size_t k = 0; k < chunkCount; ++k) {
+        if (chunkOffsets[k + 1] % 8 != 0) {
+            encoded[chunkOffsets[k + 1] / 8] |= partialBytes[k];
+        }
+    }
+}
+
 //
-int writeEncodedBits(string& bitString, char* encodedBinName)
+// Build one frequency table per block, for choosing each block's coding (adaptive mode, parallelized)
+// The whole-input table is their sum
+//
+void countBlocks(const unsigned char* content, size_t contentSize, uint64_t blockSize, int numThreads, vector<Histogram>& blockCounts, uint64_t freqs[256])
+{
+    size_t blockCount = (contentSize + blockSize - 1) / blockSize;
+    blockCounts.resize(blockCount);
+
+    int threads = regionThreads(numThreads, blockCount);
+    ThreadWork* work = stats.beginRegion("histogram", threads);
+    #pragma omp parallel for schedule(dynamic) num_threads(threads)
+    for (size_t b = 0; b < blockCount; ++b) {
+        size_t begin = b * blockSize;
+        size_t end = min(contentSize, begin + blockSize);
+        uint64_t start = work ? Stats::now() : 0;
+        fill(std::begin(blockCounts[b].counts), std::end(blockCounts[b].counts), 0);
+        countBytes(content + begin, end - begin, blockCounts[b].counts);
+        if (work) {
+            work[omp_get_thread_num()].add(Stats::now() - start, end - begin);
+        }
+    }
+
+    fill(freqs, freqs + 256, 0);
+    for (const Histogram& counts : blockCounts) {
+        for (int c = 0; c < 256; c++) {
+            freqs[c] += counts.counts[c];
+        }
+    }
+}
+
+//
+// Encode each block of the content independently (parallelized)
+// With a plan (adaptive mode), each block is coded the way it says rather than with `codes`
+//
+void encodeBlocks(const unsigned char* content, size_t contentSize, const CodeTable& codes, uint64_t blockSize, bool interleaved, int numThreads, vector<BitWriter>& blockWriters, const BlockPlan* plan = nullptr)
+{
+    size_t blockCount = (contentSize + blockSize - 1) / blockSize;
+    blockWriters.resize(blockCount);
+
+    // blocks do not depend on each other, so threads just grab the next one
+    int threads = regionThreads(numThreads, blockCount);
+    ThreadWork* work = stats.beginRegion("encode", threads);
+    #pragma omp parallel num_threads(threads)
+    {
+        PlanCodes planCodes;
+        #pragma omp for schedule(dynamic)
+        for (size_t b = 0; b < blockCount; ++b) {
+            size_t begin = b * blockSize;
+            size_t end = min(contentSize, begin + blockSize);
+            uint64_t start = work ? Stats::now() : 0;
+            BitWriter localWriter;
+            if (plan) {
+                encodePlannedBlock(*plan, b, content + begin, end - begin, interleaved, planCodes, localWriter);
+            }
+            else {
+                encodeBlock(content + begin, end - begin, codes, interleaved, localWriter);
+            }
+            blockWriters[b] = std::move(localWriter);
+            if (work) {
+                work[omp_get_thread_num()].add(Stats::now() - start, end - begin);
+            }
+        }
+    }
+}
+
+//
+// Write out encoded blocks as a block container
+// (adaptive containers pass their plan, and their stored blocks are written straight from the content)
+//
+int writeEncodedBlocks(vector<BitWriter>& blockWriters, const unsigned char* content, const uint8_t codeLengths[256], uint64_t blockSize, size_t contentSize, uint32_t flags, const char* encodedBinName, const BlockPlan* plan = nullptr)
 {
     // open file
-    ofstream binOut(encodedBinName, ifstream::binary);
-    if (!binOut) 
+    OutputWriter binOut;
+    if (binOut.open(encodedBinName) != 0) 
     {
         cout << endl;
         cout << "Error: Cannot open binary file!" << endl;
@@ -112,125 +561,743 @@ int writeEncodedBits(string& bitString, char* encodedBinName)
         return 1;
     }
 
-    // first, we will write a 64-bit header indicating the total number of bits
-    uint64_t bits64 = static_cast<uint64_t>(bitString.size());
-    binOut.write(reinterpret_cast<const char*>(&bits64), sizeof(bits64));
+    // block index: each block starts on a whole byte right after the previous one
+    vector<BlockEntry> blocks(blockWriters.size());
+    uint64_t bitOffset = 0;
+    for (size_t b = 0; b < blockWriters.size(); b++) 
+    {
+        blocks[b].bitOffset = bitOffset;
+        blocks[b].decodedLength = min<uint64_t>(blockSize, contentSize - b * blockSize);
+        bitOffset += (plan && plan->stored(b)) ? blocks[b].decodedLength * 8 : blockWriters[b].finish().size() * 8;
+    }
 
-    // then we write everything byte-by-byte (this is how we will also decode the binary file)
-    unsigned char currentByte = 0;
-    int bitCount = 0;
-    for (size_t i = 0; i < bitString.size(); i++) 
+    vector<unsigned char> header;
+    writeContainerHeader(header, blockSize, codeLengths, blocks, bitOffset, flags, plan ? &plan->codings : nullptr);
+    binOut.write(header.data(), header.size());
+    for (size_t b = 0; b < blockWriters.size(); b++) 
     {
-        currentByte <<= 1;
-        if (bitString[i] == '1') 
+        if (plan && plan->stored(b)) 
         {
-            currentByte |= 1;
+            binOut.write(content + b * blockSize, blocks[b].decodedLength);
+            continue;
         }
-        bitCount++;
-        if (bitCount == 8) // write byte
+        const vector<unsigned char>& bytes = blockWriters[b].finish();
+        binOut.write(bytes.data(), bytes.size());
+    }
+
+    if (binOut.close() != 0) 
+    {
+        cout << endl;
+        cout << "Error: Failed to write binary file!" << endl;
+        cout << endl;
+        return 1;
+    }
+    return 0;
+}
+
+/// <summary>
+/// A PipelineSlot holds one block on its way through encodePipelined: its
+/// input (read into the slot in streaming mode, straight from the mapped file
+/// otherwise) and its packed bits. Block b always goes into slot
+/// b % #slots, which is reused for the block #slots later once b is written
+/// out. `encoded` is one past the last block encoded in the slot, which is
+/// how the writer knows block b is ready.
+/// </summary>
+struct PipelineSlot {
+    const unsigned char* data = nullptr;
+    size_t length = 0;
+    vector<unsigned char> input;
+    BitWriter writer;
+    atomic<size_t> encoded{0};
+};
+
+//
+// Encode the blocks as a pipeline, so reading, encoding and writing overlap (streaming and block modes)
+// A reader thread fills the slots in block order (reading them from the file in streaming mode), every worker
+// claims the next blocks to encode from a shared counter once it is done with its last ones (a run of small
+// blocks at a time, so they do not all go through the counter one by one), and this thread writes the packed
+// blocks out in order as they are finished. A slow block only holds up the others once the blocks after it
+// have filled every slot, and memory use is PIPELINE_DEPTH claims per worker, no matter how large the input
+// is. The stages only hand blocks over through counters, without locks.
+// The block index is only known once every block is written, so a placeholder header of the same size goes out
+// first and is overwritten at the end.
+// With a plan (adaptive mode, or stored input), each block is coded the way it says rather than with `codes`,
+// and a stored block is written out straight from its input
+// `totalBits` is the size of the payload that was written
+//
+int encodePipelined(const char* inputFileName, const unsigned char* content, const CodeTable& codes, const uint8_t codeLengths[256], uint64_t blockSize, uint64_t contentSize, uint32_t flags, int numThreads, char* encodedBinName, uint64_t& totalBits, const BlockPlan* plan = nullptr)
+{
+    // open files (the input only in streaming mode, when it is not mapped)
+    ifstream infile;
+    if (!content) 
+    {
+        infile.open(inputFileName, ifstream::binary);
+        if (!infile) 
         {
-            binOut.put(static_cast<char>(currentByte));
-            currentByte = 0;
-            bitCount = 0;
+            cout << endl;
+            cout << "Error: Cannot open .txt file!" << endl;
+            cout << endl;
+            return 1;
         }
     }
+    OutputWriter binOut;
+    if (binOut.open(encodedBinName, true) != 0) 
+    {
+        cout << endl;
+        cout << "Error: Cannot open binary file!" << endl;
+        cout << endl;
+        return 1;
+    }
+
+    // placeholder header, the same size as the real one
+    size_t blockCount = static_cast<size_t>((contentSize + blockSize - 1) / blockSize);
+    vector<BlockEntry> blocks(blockCount);
+    bool interleaved = (flags & FLAG_INTERLEAVED);
+    const BlockCodings* codings = plan ? &plan->codings : nullptr;
+    vector<unsigned char> header;
+    writeContainerHeader(header, blockSize, codeLengths, blocks, 0, flags, codings);
+    binOut.write(header.data(), header.size());
 
-    // pad leftover bits with 0s
-    if (bitCount > 0) 
+    // the slots, and how far each stage has got: blocks below `readCount` are in their slots, blocks below
+    // `writtenCount` are written out (and their slots free), `nextBlock` is the next one a worker may claim
+    // (no more workers than claims)
+    size_t claimBlocks = static_cast<size_t>(min<uint64_t>(PIPELINE_CLAIM_BLOCKS, max<uint64_t>(1, SCHEDULE_CHUNK_SIZE / blockSize)));
+    numThreads = regionThreads(numThreads, (blockCount + claimBlocks - 1) / claimBlocks);
+    size_t slotCount = static_cast<size_t>(numThreads) * claimBlocks * PIPELINE_DEPTH;
+    vector<PipelineSlot> slots(slotCount);
+    atomic<size_t> readCount(0);
+    atomic<size_t> writtenCount(0);
+    atomic<size_t> nextBlock(0);
+    atomic<bool> abort(false);
+    bool readFailed = false; // only looked at once the reader is joined
+
+    // reader: wait for the next block's slot to be written out, then fill it in
+    thread reader([&]() {
+        for (size_t b = 0; b < blockCount; b++) {
+            if (!waitUntil([&]() { return b < writtenCount.load(memory_order_acquire) + slotCount; }, abort)) {
+                return;
+            }
+            PipelineSlot& slot = slots[b % slotCount];
+            slot.length = static_cast<size_t>(min<uint64_t>(blockSize, contentSize - b * blockSize));
+            if (content) {
+                slot.data = content + b * blockSize;
+            }
+            else {
+                slot.input.resize(slot.length);
+                if (!infile.read(reinterpret_cast<char*>(slot.input.data()), slot.length)) {
+                    readFailed = true;
+                    abort.store(true, memory_order_release);
+                    return;
+                }
+                slot.data = slot.input.data();
+            }
+            readCount.store(b + 1, memory_order_release);
+        }
+    });
+
+    // workers: claim the next blocks, wait for each to be read and encode it (into the slot's writer, keeping its buffer)
+    ThreadWork* work = stats.beginRegion("encode", numThreads);
+    vector<thread> workers;
+    for (int w = 0; w < numThreads; w++) 
     {
-        currentByte <<= (8 - bitCount);
-        binOut.put(static_cast<char>(currentByte));
+        workers.emplace_back([&, w]() {
+            PlanCodes planCodes;
+            for (size_t first = nextBlock.fetch_add(claimBlocks); first < blockCount; first = nextBlock.fetch_add(claimBlocks)) {
+                size_t last = min(blockCount, first + claimBlocks);
+                for (size_t b = first; b < last; b++) {
+                    if (!waitUntil([&]() { return b < readCount.load(memory_order_acquire); }, abort)) {
+                        return;
+                    }
+                    PipelineSlot& slot = slots[b % slotCount];
+                    uint64_t start = work ? Stats::now() : 0;
+                    slot.writer.clear();
+                    if (plan) {
+                        encodePlannedBlock(*plan, b, slot.data, slot.length, interleaved, planCodes, slot.writer);
+                    }
+                    else {
+                        encodeBlock(slot.data, slot.length, codes, interleaved, slot.writer);
+                    }
+                    slot.writer.finish();
+                    if (work) {
+                        work[w].add(Stats::now() - start, slot.length);
+                    }
+                    slot.encoded.store(b + 1, memory_order_release);
+                }
+            }
+        });
     }
 
-    binOut.close();
+    // writer (this thread): wait for the blocks in order, write them out and free their slots
+    uint64_t bitOffset = 0;
+    for (size_t b = 0; b < blockCount; b++) 
+    {
+        PipelineSlot& slot = slots[b % slotCount];
+        if (!waitUntil([&]() { return slot.encoded.load(memory_order_acquire) == b + 1; }, abort)) 
+        {
+            break;
+        }
+        blocks[b].bitOffset = bitOffset;
+        blocks[b].decodedLength = slot.length;
+        if (plan && plan->stored(b)) 
+        {
+            binOut.write(slot.data, slot.length);
+            bitOffset += static_cast<uint64_t>(slot.length) * 8;
+        }
+        else 
+        {
+            const vector<unsigned char>& bytes = slot.writer.finish();
+            binOut.write(bytes.data(), bytes.size());
+            bitOffset += static_cast<uint64_t>(bytes.size()) * 8;
+        }
+        writtenCount.store(b + 1, memory_order_release);
+    }
+    reader.join();
+    for (thread& worker : workers) 
+    {
+        worker.join();
+    }
+    if (readFailed) 
+    {
+        cout << endl;
+        cout << "Error: .txt file changed while it was being encoded!" << endl;
+        cout << endl;
+        return 1;
+    }
+
+    // now the real header
+    totalBits = bitOffset;
+    header.clear();
+    writeContainerHeader(header, blockSize, codeLengths, blocks, bitOffset, flags, codings);
+    binOut.writeAt(0, header.data(), header.size());
+    if (binOut.close() != 0) 
+    {
+        cout << endl;
+        cout << "Error: Failed to write binary file!" << endl;
+        cout << endl;
+        return 1;
+    }
+    return 0;
+}
+
+/// <summary>
+/// BatchScratch holds one thread's buffers in batch mode: the file it is
+/// working on, the encoded bytes, and an Encoder (which keeps its own tables
+/// and writers). They are reused from one file to the next, so after the
+/// first few files a thread stops allocating.
+/// </summary>
+struct BatchScratch {
+    explicit BatchScratch(const EncodeOptions& options)
+        : encoder(options) {}
+
+    vector<unsigned char> content;
+    vector<uint8_t> encoded;
+    Encoder encoder;
+};
+
+//
+// Encodes one file of a batch on the calling thread, as a single block, using that thread's scratch buffers
+//
+int encodeBatchFile(const BatchFile& file, BatchScratch& scratch)
+{
+    // read the whole file into the scratch buffer
+    ifstream infile(file.input, ifstream::binary);
+    scratch.content.resize(file.size);
+    if (!infile || (file.size > 0 && !infile.read(reinterpret_cast<char*>(scratch.content.data()), file.size))) 
+    {
+        return 1;
+    }
+
+    // the same container a normal run writes for a single block
+    if (scratch.encoder.encode(scratch.content, scratch.encoded) != 0) 
+    {
+        return 1;
+    }
+    return OutputWriter::writeFile(file.output.c_str(), scratch.encoded.data(), scratch.encoded.size());
+}
+
+//
+// Encodes one file of a batch that is bigger than a block, split into blocks and using every thread
+// (against the model if there is one, which needs no counting, and stored if coding would not shrink it enough,
+// which against the model is only known once it is coded)
+//
+int encodeLargeBatchFile(const BatchFile& file, const EncodeOptions& options)
+{
+    MappedFile input;
+    if (input.open(file.input.c_str()) != 0) 
+    {
+        return 1;
+    }
+    uint8_t codeLengths[256];
+    CodeTable codes;
+    BlockPlan plan;
+    bool stored = false;
+    if (options.model) 
+    {
+        copy(options.model->codeLengths, options.model->codeLengths + 256, codeLengths);
+        generateCodes(codeLengths, codes);
+    }
+    else 
+    {
+        uint64_t freqs[256];
+        countContent(input.data(), input.size(), options.numThreads, freqs);
+        if (buildHuffmanTree(freqs, options.maxCodeLength, codeLengths, codes, true) != 0) 
+        {
+            return 1;
+        }
+        stored = storeInstead(singleTableBits(freqs, codeLengths), input.size(), options.minSaving);
+        if (stored) 
+        {
+            planStored((input.size() + options.blockSize - 1) / options.blockSize, plan);
+            fill(codeLengths, codeLengths + 256, 0);
+        }
+    }
+    vector<BitWriter> blockWriters;
+    encodeBlocks(input.data(), input.size(), codes, options.blockSize, options.interleaved, options.numThreads, blockWriters, stored ? &plan : nullptr);
+
+    // against the model, whether coding pays is only known once it is done
+    if (options.model) 
+    {
+        uint64_t codedBits = 0;
+        for (BitWriter& blockWriter : blockWriters) 
+        {
+            codedBits += blockWriter.finish().size() * 8;
+        }
+        stored = storeInstead(codedBits, input.size(), options.minSaving);
+        if (stored) 
+        {
+            planStored(blockWriters.size(), plan);
+            fill(codeLengths, codeLengths + 256, 0);
+        }
+    }
+    uint32_t flags = (options.interleaved ? FLAG_INTERLEAVED : 0) | ((options.model && !stored) ? FLAG_SHARED_MODEL : 0) | (stored ? FLAG_ADAPTIVE : 0);
+    return writeEncodedBlocks(blockWriters, input.data(), codeLengths, options.blockSize, input.size(), flags, file.output.c_str(), stored ? &plan : nullptr);
+}
+
+//
+// Encodes every file of a batch in one process, returns the number of files that failed
+// Files bigger than a block are encoded first, one after another, each split into blocks across every thread.
+// The rest go whole to whichever thread is free next, largest first, so a few big files at the end cannot
+// leave the other threads idle
+// `options` are those of the large files, with their block size and every thread
+//
+size_t encodeBatch(const vector<BatchFile>& files, const EncodeOptions& options)
+{
+    int numThreads = options.numThreads;
+    uint64_t blockSize = options.blockSize;
+    vector<size_t> large;
+    vector<size_t> small;
+    for (size_t i = 0; i < files.size(); i++) 
+    {
+        (files[i].size > blockSize ? large : small).push_back(i);
+    }
+    sort(small.begin(), small.end(), [&](size_t a, size_t b) { return files[a].size > files[b].size; });
+
+    // adaptive large files go through an Encoder of their own, which plans their blocks with every thread
+    vector<char> failed(files.size(), 0);
+    BatchScratch largeScratch(options);
+    for (size_t i : large) 
+    {
+        failed[i] = options.adaptive
+            ? (encodeBatchFile(files[i], largeScratch) != 0)
+            : (encodeLargeBatchFile(files[i], options) != 0);
+    }
+
+    // small files are a single block each, on one thread
+    EncodeOptions smallOptions = options;
+    smallOptions.blockSize = 0;
+    smallOptions.numThreads = 1;
+    int threads = regionThreads(numThreads, small.size());
+    vector<BatchScratch> scratch;
+    for (int t = 0; t < threads; t++) 
+    {
+        scratch.emplace_back(smallOptions);
+    }
+    ThreadWork* work = stats.beginRegion("batch", threads);
+    #pragma omp parallel for schedule(dynamic) num_threads(threads)
+    for (size_t k = 0; k < small.size(); ++k) {
+        int tid = omp_get_thread_num();
+        uint64_t start = work ? Stats::now() : 0;
+        const BatchFile& file = files[small[k]];
+        failed[small[k]] = (encodeBatchFile(file, scratch[tid]) != 0);
+        if (work) {
+            work[tid].add(Stats::now() - start, file.size);
+        }
+    }
+
+    // say which files failed, now that the threads are done
+    size_t failures = 0;
+    for (size_t i = 0; i < files.size(); i++) 
+    {
+        if (failed[i]) 
+        {
+            cout << endl;
+            cout << "Error: Cannot encode " << files[i].input << " to " << files[i].output << "!" << endl;
+            cout << endl;
+            failures++;
+        }
+    }
+    return failures;
+}
+
+//
+// Runs a whole batch: lists the files, encodes them and reports the totals
+//
+int runBatch(const char* batchList, const char* outDir, const EncodeOptions& options)
+{
+    auto list_start = chrono::high_resolution_clock::now();
+    vector<BatchFile> files;
+    if (listBatch(batchList, outDir, "", ".bin", files) != 0) 
+    {
+        return 1;
+    }
+    auto list_end = chrono::high_resolution_clock::now();
+    auto diff = list_end - list_start;
+    auto duration = chrono::duration_cast<chrono::milliseconds>(diff);
+    cout << "Listed " << files.size() << " files in " << duration.count() << " ms..." << endl;
+    stats.addStage("list", diff);
+
+    auto encode_start = chrono::high_resolution_clock::now();
+    size_t failures = encodeBatch(files, options);
+    auto encode_end = chrono::high_resolution_clock::now();
+    diff = encode_end - encode_start;
+    duration = chrono::duration_cast<chrono::milliseconds>(diff);
+    cout << "Encoded files in " << duration.count() << " ms..." << endl;
+    stats.addStage("encode", diff);
+
+    // totals over the files that made it
+    uint64_t originalSizeBytes = 0;
+    uint64_t encodedSizeBytes = 0;
+    for (const BatchFile& file : files) 
+    {
+        std::error_code error;
+        uint64_t encodedSize = std::filesystem::file_size(file.output, error);
+        if (!error) 
+        {
+            originalSizeBytes += file.size;
+            encodedSizeBytes += encodedSize;
+        }
+    }
+    double ratio = (originalSizeBytes > 0) ? (double) encodedSizeBytes / originalSizeBytes : 0.0;
+    cout << "Compression %: " << ratio << endl;
+
+    if (stats.enabled()) 
+    {
+        stats.setCounter("files", files.size());
+        stats.setCounter("failed_files", failures);
+        stats.setCounter("input_bytes", originalSizeBytes);
+        stats.setCounter("output_bytes", encodedSizeBytes);
+        stats.setCounter("threads", options.numThreads);
+        stats.print(cerr);
+    }
+    return (failures == 0) ? 0 : 1;
+}
+
+//
+// Trains a shared model on sample files and saves it (training mode)
+// Every sample is counted with all threads, and the counts of all of them together make the model
+//
+int runTrain(const char* sampleList, const char* modelFile, int numThreads, int maxCodeLength)
+{
+    // count every sample
+    auto count_start = chrono::high_resolution_clock::now();
+    vector<string> samples;
+    if (listInputs(sampleList, samples) != 0) 
+    {
+        cout << endl;
+        cout << "Error: Cannot read sample list or directory " << sampleList << "!" << endl;
+        cout << endl;
+        return 1;
+    }
+    uint64_t freqs[256] = {};
+    uint64_t sampleBytes = 0;
+    for (const string& sample : samples) 
+    {
+        MappedFile input;
+        if (input.open(sample.c_str()) != 0) 
+        {
+            cout << endl;
+            cout << "Error: Cannot open " << sample << "!" << endl;
+            cout << endl;
+            return 1;
+        }
+        uint64_t sampleFreqs[256];
+        countContent(input.data(), input.size(), numThreads, sampleFreqs);
+        for (int c = 0; c < 256; c++) 
+        {
+            freqs[c] += sampleFreqs[c];
+        }
+        sampleBytes += input.size();
+    }
+    auto count_end = chrono::high_resolution_clock::now();
+    auto diff = count_end - count_start;
+    auto duration = chrono::duration_cast<chrono::milliseconds>(diff);
+    cout << "Counted " << samples.size() << " sample files in " << duration.count() << " ms..." << endl;
+    stats.addStage("histogram", diff);
+
+    // train and save the model
+    auto train_start = chrono::high_resolution_clock::now();
+    Model model;
+    if (trainModel(freqs, maxCodeLength, model) != 0) 
+    {
+        cout << endl;
+        cout << "Error: Codes of at most " << maxCodeLength << " bits cannot cover every byte value!" << endl;
+        cout << endl;
+        return 1;
+    }
+    if (writeModel(modelFile, model) != 0) 
+    {
+        cout << endl;
+        cout << "Error: Cannot write model file!" << endl;
+        cout << endl;
+        return 1;
+    }
+    auto train_end = chrono::high_resolution_clock::now();
+    diff = train_end - train_start;
+    duration = chrono::duration_cast<chrono::milliseconds>(diff);
+    cout << "Trained model in " << duration.count() << " ms to " << modelFile << "..." << endl;
+    stats.addStage("train", diff);
+
+    // how well it does on the samples themselves (without any per-file header)
+    uint64_t encodedBytes = (countEncodedBits(freqs, model.codeLengths) + 7) / 8;
+    double ratio = (sampleBytes > 0) ? (double) encodedBytes / sampleBytes : 0.0;
+    cout << "Compression % on samples: " << ratio << endl;
+
+    if (stats.enabled()) 
+    {
+        stats.setCounter("files", samples.size());
+        stats.setCounter("input_bytes", sampleBytes);
+        stats.setCounter("encoded_bits", countEncodedBits(freqs, model.codeLengths));
+        stats.setCounter("distinct_bytes", count_if(freqs, freqs + 256, [](uint64_t freq) { return freq > 0; }));
+        stats.setCounter("max_code_length", *max_element(model.codeLengths, model.codeLengths + 256));
+        stats.setCounter("threads", numThreads);
+        stats.print(cerr);
+    }
     return 0;
 }
 
 int main(int argc, char* argv[]) 
 {
-    // 1) Read command line arguments (returns default file "encoded_output.bin" and "tree.json")
+    // 1) Read command line arguments (returns default file "encoded_output.bin")
     char* inputFileName = nullptr;
-    char* treeJsonName = "tree.json";
     char* encodedBinName = "encoded_output.bin";
-    int numThreads = 1; // default 1 thread
-    if (readArgs(argc, argv, inputFileName, numThreads) != 0) 
+    char* outPath = nullptr; // default one file, not a batch or training
+    bool training = false; // default encode, not train a model
+    int numThreads = 0; // default auto
+    uint64_t blockSize = 0; // default one continuous bitstream
+    bool streaming = false; // default whole file in memory
+    bool interleaved = false; // default one stream per block
+    bool adaptive = false; // default one table for every block
+    double minSaving = DEFAULT_MIN_SAVING; // default store unless coding saves 1%
+    int mapHints = 0; // default no extra mapping hints
+    int maxCodeLength = 0; // default only capped at MAX_CODE_LENGTH
+    char* modelFile = nullptr; // default each input's own codes
+    Stats::Format statsFormat = Stats::NONE; // default no stats
+    if (readArgs(argc, argv, inputFileName, outPath, training, numThreads, blockSize, streaming, interleaved, adaptive, minSaving, mapHints, maxCodeLength, modelFile, statsFormat) != 0) 
     {
         return 1;
     }
+    if ((streaming || interleaved || adaptive || outPath) && blockSize == 0) 
+    {
+        blockSize = DEFAULT_BLOCK_SIZE;
+    }
+    stats.enable("encode-parallel", statsFormat);
     cout << "Read arguments..." << endl;
 
-    // 2) Read input file
+    // #threads left to auto: sized to the input for a single file, one per core for a batch or training run
+    if (numThreads == 0) 
+    {
+        std::error_code error;
+        uint64_t inputSize = outPath ? UINT64_MAX : std::filesystem::file_size(inputFileName, error);
+        numThreads = autoThreads(error ? UINT64_MAX : inputSize);
+        cout << "Using " << numThreads << " threads..." << endl;
+    }
+
+    // training mode writes a model instead of encoding anything
+    if (training) 
+    {
+        return runTrain(inputFileName, outPath, numThreads, maxCodeLength);
+    }
+
+    // a shared model is read once, up front
+    Model model;
+    const Model* sharedModel = nullptr;
+    if (modelFile) 
+    {
+        auto model_start = chrono::high_resolution_clock::now();
+        if (readModel(modelFile, model) != 0) 
+        {
+            cout << endl;
+            cout << "Error: Cannot read model file, or it is not a model!" << endl;
+            cout << endl;
+            return 1;
+        }
+        sharedModel = &model;
+        auto model_end = chrono::high_resolution_clock::now();
+        cout << "Read model in " << chrono::duration_cast<chrono::milliseconds>(model_end - model_start).count() << " ms..." << endl;
+        stats.addStage("model", model_end - model_start);
+    }
+
+    // batch mode runs every file through its own loop
+    if (outPath) 
+    {
+        EncodeOptions options;
+        options.blockSize = blockSize;
+        options.interleaved = interleaved;
+        options.maxCodeLength = maxCodeLength;
+        options.numThreads = numThreads;
+        options.model = sharedModel;
+        options.adaptive = adaptive;
+        options.minSaving = minSaving;
+        return runBatch(inputFileName, outPath, options);
+    }
+
+    // 2) Map input file (streaming mode leaves it on disk and reads it in each pass)
     auto read_start = chrono::high_resolution_clock::now();
-    string content;
-    if (readInputFile(inputFileName, content) != 0) 
+    MappedFile input;
+    if (!streaming && readInputFile(inputFileName, input, mapHints) != 0) 
     {
         return 1;
     }
+    const unsigned char* content = input.data();
     auto read_end = chrono::high_resolution_clock::now();
     auto diff = read_end - read_start;
     auto duration = chrono::duration_cast<chrono::milliseconds>(diff);
     cout << "Read input file in " << duration.count() << " ms..." << endl;
+    stats.addStage("read", diff);
 
-    // 3) Build frequency map (parallelized)
-    auto build_start = chrono::high_resolution_clock::now();
-    unordered_map<char, int> freqMap;
-    vector<unordered_map<char, int>> threadMaps(numThreads);
-    #pragma omp parallel num_threads(numThreads)
+    // 3) Build frequency table (parallelized, or one buffer at a time in streaming mode, or one per block in adaptive mode)
+    //    A shared model already has its codes, so the input is not counted at all
+    uint64_t freqs[256] = {};
+    vector<Histogram> blockCounts;
+    uint64_t contentSize = input.size();
+    if (sharedModel && streaming) 
     {
-        int tid = omp_get_thread_num();
-        #pragma omp for nowait
-        for (size_t i = 0; i < content.size(); ++i) {
-            unsigned char uc = static_cast<unsigned char>(content[i]);
-            threadMaps[tid][static_cast<char>(uc)]++;
+        std::error_code error;
+        contentSize = std::filesystem::file_size(inputFileName, error);
+        if (error) 
+        {
+            cout << endl;
+            cout << "Error: Cannot open .txt file!" << endl;
+            cout << endl;
+            return 1;
         }
     }
-    // combine frequency maps from all threads
-    for (const auto& localMap : threadMaps) {
-        for (const auto& [ch, count] : localMap) {
-            freqMap[ch] += count;
+    if (!sharedModel) 
+    {
+        auto build_start = chrono::high_resolution_clock::now();
+        if (streaming && countInputFile(inputFileName, freqs, contentSize) != 0) 
+        {
+            return 1;
         }
+        if (adaptive) {
+            countBlocks(content, contentSize, blockSize, numThreads, blockCounts, freqs);
+        }
+        else if (!streaming) {
+            countContent(content, contentSize, numThreads, freqs);
+        }
+        auto build_end = chrono::high_resolution_clock::now();
+        diff = build_end - build_start;
+        duration = chrono::duration_cast<chrono::milliseconds>(diff);
+        cout << "Built frequency table in " << duration.count() << " ms..." << endl;
+        stats.addStage("histogram", diff);
     }
-    auto build_end = chrono::high_resolution_clock::now();
-    diff = build_end - build_start;
-    duration = chrono::duration_cast<chrono::milliseconds>(diff);
-    cout << "Built frequency map in " << duration.count() << " ms..." << endl;
 
-    // 4) Build Huffman tree and get each character's corresponding bit string, and write out
+    // 4) Build Huffman tree and get each character's code length and corresponding bit string
+    //    (or take the code lengths straight from the shared model, or choose a table for every block in adaptive mode)
+    //    Input that coding would not shrink by at least minSaving is stored as it is instead
     auto tree_start = chrono::high_resolution_clock::now();
-    unordered_map<char, string> codes;
-    if (buildHuffmanTree(freqMap, codes, treeJsonName) != 0) 
+    uint8_t codeLengths[256] = {};
+    CodeTable codes;
+    BlockPlan plan;
+    bool stored = false;
+    if (sharedModel) 
+    {
+        copy(model.codeLengths, model.codeLengths + 256, codeLengths);
+        generateCodes(codeLengths, codes);
+    }
+    else if (adaptive) 
+    {
+        if (planBlocks(blockCounts.data(), blockCounts.size(), maxCodeLength, interleaved, minSaving, plan) != 0) 
+        {
+            cout << endl;
+            cout << "Error: Codes of at most " << maxCodeLength << " bits cannot cover every byte in a block!" << endl;
+            cout << endl;
+            return 1;
+        }
+    }
+    else if (buildHuffmanTree(freqs, maxCodeLength, codeLengths, codes) != 0) 
     {
         return 1;
     }
+    else if (storeInstead(singleTableBits(freqs, codeLengths), contentSize, minSaving)) 
+    {
+        // stored input is an adaptive container whose blocks are all stored (one block unless there were blocks already)
+        stored = true;
+        if (blockSize == 0) 
+        {
+            blockSize = contentSize;
+        }
+        planStored(static_cast<size_t>((contentSize + blockSize - 1) / blockSize), plan);
+        fill(codeLengths, codeLengths + 256, 0);
+    }
     auto tree_end = chrono::high_resolution_clock::now();
     diff = tree_end - tree_start;
     duration = chrono::duration_cast<chrono::milliseconds>(diff);
-    cout << "Built Huffman Tree in " << duration.count() << " ms..." << endl;
+    cout << (sharedModel ? "Built codes from model in " : adaptive ? "Planned blocks in " : "Built Huffman Tree in ") << duration.count() << " ms..." << endl;
+    stats.addStage("tree", diff);
+    size_t storedBlocks = count(plan.codings.kinds.begin(), plan.codings.kinds.end(), BLOCK_STORED);
+    if (adaptive) 
+    {
+        cout << "Blocks: " << plan.codings.tables.size() << " with a new table, " << blockCounts.size() - plan.codings.tables.size() - storedBlocks << " reusing one, " << storedBlocks << " stored..." << endl;
+    }
+    if (stored) 
+    {
+        cout << "Coding would save less than " << minSaving * 100 << "%, storing the input as is..." << endl;
+    }
 
-    // 5) Encode content into bits (parallelized)
+    // 5) Encode content into packed bits (parallelized), either as one stream or as independent blocks
+    //    (blocks go through a pipeline that reads, encodes and writes them at the same time, streaming mode
+    //    reading them from the file rather than the mapping)
     auto encode_start = chrono::high_resolution_clock::now();
-    string bitString;
-    #pragma omp parallel num_threads(numThreads)
-    {
-        string localBitString;
-        #pragma omp for nowait
-        for (size_t i = 0; i < content.size(); ++i) {
-            unsigned char uc = static_cast<unsigned char>(content[i]);
-            localBitString += codes[static_cast<char>(uc)];
+    vector<unsigned char> encoded;
+    uint64_t totalBits = 0;
+    uint32_t flags = (interleaved ? FLAG_INTERLEAVED : 0) | (sharedModel ? FLAG_SHARED_MODEL : 0) | ((adaptive || stored) ? FLAG_ADAPTIVE : 0);
+    const BlockPlan* blockPlan = (adaptive || stored) ? &plan : nullptr;
+    if (blockSize > 0) {
+        if (encodePipelined(inputFileName, streaming ? nullptr : content, codes, codeLengths, blockSize, contentSize, flags, numThreads, encodedBinName, totalBits, blockPlan) != 0) {
+            return 1;
+        }
+    }
+    else {
+        encodeStream(content, contentSize, codes, numThreads, encoded, totalBits);
+    }
+
+    // against a shared model, whether coding pays is only known once it is done: if not, the input is stored after all
+    // (the block pipeline has then already written the coded file, which is written over, the price of not counting)
+    if (sharedModel && storeInstead(totalBits, contentSize, minSaving)) {
+        cout << "Coding would save less than " << minSaving * 100 << "%, storing the input as is..." << endl;
+        stored = true;
+        if (blockSize == 0) {
+            blockSize = contentSize;
+        }
+        planStored(static_cast<size_t>((contentSize + blockSize - 1) / blockSize), plan);
+        storedBlocks = plan.codings.kinds.size();
+        fill(codeLengths, codeLengths + 256, 0);
+        flags = (interleaved ? FLAG_INTERLEAVED : 0) | FLAG_ADAPTIVE;
+        if (encodePipelined(inputFileName, streaming ? nullptr : content, codes, codeLengths, blockSize, contentSize, flags, numThreads, encodedBinName, totalBits, &plan) != 0) {
+            return 1;
         }
-        
-        #pragma omp critical
-        bitString += localBitString;
     }
     auto encode_end = chrono::high_resolution_clock::now();
     diff = encode_end - encode_start;
     duration = chrono::duration_cast<chrono::milliseconds>(diff);
     cout << "Encoded file in " << duration.count() << " ms..." << endl;
+    stats.addStage("encode", diff);
 
-
-    // 6) Write out to binary file
+    // 6) Write out to binary file (the block pipeline has already written it)
     auto write_start = chrono::high_resolution_clock::now();
-    if (writeEncodedBits(bitString, encodedBinName) != 0) 
+    int written = (blockSize > 0) ? 0 : writeEncodedBits(encoded, codeLengths, contentSize, flags, encodedBinName);
+    if (written != 0) 
     {
         return 1;
     }
@@ -238,6 +1305,7 @@ int main(int argc, char* argv[])
     diff = write_end - write_start;
     duration = chrono::duration_cast<chrono::milliseconds>(diff);
     cout << "Wrote file in " << duration.count() << " ms..." << endl;
+    stats.addStage("write", diff);
 
     // 7) Calculate % compression
     size_t originalSizeBytes = std::filesystem::file_size(inputFileName);
@@ -245,6 +1313,35 @@ int main(int argc, char* argv[])
     double ratio = (double) encodedSizeBytes / originalSizeBytes;
     cout << "Compression %: " << ratio << endl;
 
+    // 8) Print timings and counters (only with --stats)
+    if (stats.enabled()) 
+    {
+        stats.setCounter("input_bytes", contentSize);
+        stats.setCounter("output_bytes", encodedSizeBytes);
+        if (!sharedModel) // a model gives every byte a code, and the input was never counted
+        {
+            stats.setCounter("distinct_bytes", count_if(freqs, freqs + 256, [](uint64_t freq) { return freq > 0; }));
+        }
+        if (!sharedModel && !adaptive && !stored) 
+        {
+            stats.setCounter("encoded_bits", countEncodedBits(freqs, codeLengths));
+        }
+        int maxLength = *max_element(codeLengths, codeLengths + 256);
+        for (const auto& table : plan.codings.tables) 
+        {
+            maxLength = max<int>(maxLength, *max_element(table.begin(), table.end()));
+        }
+        stats.setCounter("max_code_length", maxLength);
+        stats.setCounter("blocks", (blockSize > 0) ? (contentSize + blockSize - 1) / blockSize : 0);
+        if (adaptive || stored) 
+        {
+            stats.setCounter("new_tables", plan.codings.tables.size());
+            stats.setCounter("stored_blocks", storedBlocks);
+        }
+        stats.setCounter("threads", numThreads);
+        stats.print(cerr);
+    }
+
     // done
     return 0;
 }
\ No newline at end of file
@@ -6,29 +6,96 @@
 // Aryaman C
 //
 
+#include <algorithm>
 #include <chrono>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <string>
-#include <sstream>
-#include <unordered_map>
 #include <vector>
 
+#include "adaptive.h"
+#include "bitwriter.h"
+#include "container.h"
+#include "histogram.h"
 #include "huffman.h"
+#include "mappedfile.h"
+#include "options.h"
+#include "stats.h"
 
 using namespace std;
 using namespace std::chrono;
 
+// streaming mode reads this much per call in the counting pass
+static const size_t STREAM_BUFFER_SIZE = 1 << 20;
+
+// streaming mode encodes blocks of this size unless --block-size says otherwise
+static const uint64_t STREAM_BLOCK_SIZE = 1 << 20;
+
+// timings and counters, only collected with --stats
+static Stats stats;
+
 //
 // Reads the arguments from the command line
+// --max-code-length caps how long any code may get (1 to 64 bits)
+// --stats=json or --stats=csv prints timings and counters to stderr when done
+// --populate and --huge-pages are hints for mapping the input (see MappedFile)
+// --stream encodes in two passes over the file without ever holding all of it, one block at a time
+// --min-saving <percent> is how much smaller than the input coding has to make it, or it is stored as it is (see storeInstead)
 //
-int readArgs(int argc, char* argv[], char*& inputFile)
+int readArgs(int argc, char* argv[], char*& inputFile, bool& streaming, uint64_t& blockSize, double& minSaving, int& mapHints, int& maxCodeLength, Stats::Format& statsFormat)
 {
-    if (argc != 2)
+    bool valid = (argc >= 2);
+    bool sizeGiven = false;
+    for (int i = 2; valid && i < argc; i++)
+    {
+        string option = argv[i];
+        if (option == "--stream")
+        {
+            streaming = true;
+        }
+        else if (option == "--max-code-length" && i + 1 < argc)
+        {
+            maxCodeLength = atoi(argv[++i]);
+            valid = (maxCodeLength >= 1 && maxCodeLength <= MAX_CODE_LENGTH);
+        }
+        else if (option == "--min-saving" && i + 1 < argc)
+        {
+            valid = (parsePercent(argv[++i], minSaving) == 0);
+        }
+        else if (Stats::isOption(option, statsFormat))
+        {
+            valid = (statsFormat != Stats::NONE);
+        }
+        else if (option == "--populate")
+        {
+            mapHints |= MappedFile::POPULATE;
+        }
+        else if (option == "--huge-pages")
+        {
+            mapHints |= MappedFile::HUGE_PAGES;
+        }
+        else if (option == "--block-size" && i + 1 < argc && parseSize(argv[i + 1], blockSize) == 0 && blockSize > 0)
+        {
+            sizeGiven = true;
+            i++;
+        }
+        else
+        {
+            valid = false;
+        }
+    }
+    if (!valid)
+    {
+        cout << endl;
+        cout << "Usage: " << argv[0] << " = <input.txt> [--stream [--block-size <bytes, e.g. 1M>]] [--max-code-length <bits>] [--min-saving <percent, e.g. 1>] [--populate] [--huge-pages] [--stats=json|csv]" << endl;;
+        cout << endl;
+        return 1;
+    }
+    if (sizeGiven && !streaming)
     {
         cout << endl;
-        cout << "Usage: " << argv[0] << " = <input.txt>" << endl;;
+        cout << "Error: --block-size only applies with --stream!" << endl;
         cout << endl;
         return 1;
     }
@@ -38,9 +105,27 @@ int readArgs(int argc, char* argv[], char*& inputFile)
 }
 
 //
-// Reads the input file
+// Maps the input file
+// The file is memory-mapped read-only, so the later stages read it in place rather than from a copy
 //
-int readInputFile(const char* inputFileName, string& content)
+int readInputFile(const char* inputFileName, MappedFile& input, int mapHints)
+{
+    // open file
+    if (input.open(inputFileName, mapHints) != 0) 
+    {
+        cout << endl;
+        cout << "Error: Cannot open .txt file!" << endl;
+        cout << endl;
+        return 1;
+    }
+    return 0;
+}
+
+//
+// Build frequency table by reading the input one buffer at a time (streaming mode)
+// Returns the number of bytes read, which the second pass encodes
+//
+int countInputFile(const char* inputFileName, uint64_t freqs[256], uint64_t& contentSize)
 {
     // open file
     ifstream infile(inputFileName, ifstream::binary);
@@ -52,64 +137,95 @@ int readInputFile(const char* inputFileName, string& content)
         return 1;
     }
 
-    // read entire file into string
-    ostringstream buffer;
-    buffer << infile.rdbuf();
-    content = buffer.str();
+    // count each buffer as it comes in
+    fill(freqs, freqs + 256, 0);
+    contentSize = 0;
+    vector<unsigned char> buffer(STREAM_BUFFER_SIZE);
+    while (infile) 
+    {
+        infile.read(reinterpret_cast<char*>(buffer.data()), buffer.size());
+        size_t got = static_cast<size_t>(infile.gcount());
+        countBytes(buffer.data(), got, freqs);
+        contentSize += got;
+    }
+    if (infile.bad()) 
+    {
+        cout << endl;
+        cout << "Error: Failed to read .txt file!" << endl;
+        cout << endl;
+        return 1;
+    }
+
     infile.close();
     return 0;
 }
 
 //
-// Build frequency map
+// Build frequency table (one count per byte value)
 //
-unordered_map<char, int> buildFrequencyMap(const string& content)
+void buildFrequencyTable(const unsigned char* content, size_t contentSize, uint64_t freqs[256])
 {
-    unordered_map<char, int> freqMap;
-    for (unsigned char uc : content) 
+    for (int c = 0; c < 256; c++) 
     {
-        freqMap[static_cast<char>(uc)]++;
+        freqs[c] = 0;
     }
-    return freqMap;
+    countBytes(content, contentSize, freqs);
 }
 
 //
-// Build Huffman tree, generate codes, and write to JSON
+// Build Huffman tree, then derive code lengths and canonical codes from it
+// The code lengths are all the decoder needs, they go into the header of the binary file
+// A tree deeper than `maxCodeLength` (or than MAX_CODE_LENGTH, if no limit was given) is replaced by
+// the best code lengths within the limit, and the cost of that is reported
 //
-int buildHuffmanTree(unordered_map<char, int>& freqMap, unordered_map<char, string>& codes, char* treeJsonName)
+int buildHuffmanTree(const uint64_t freqs[256], int maxCodeLength, uint8_t codeLengths[256], CodeTable& codes)
 {
-    // build tree
-    HuffmanNode* root = buildHuffmanTree(freqMap);
-    if (!root) 
+    // build tree (an empty input has no tree and no codes)
+    HuffmanTree tree;
+    buildHuffmanTree(freqs, tree);
+    computeCodeLengths(tree, codeLengths);
+    if (tree.empty()) 
     {
-        cout << endl;
-        cout << "Error: Cannot build tree!" << endl;
-        cout << endl;
-        return 1;
+        return 0;
     }
 
-    // generate bit strings for each character
-    generateCodes(root, "", codes);
+    // cap the code lengths if the tree is too deep
+    int limit = (maxCodeLength > 0) ? maxCodeLength : MAX_CODE_LENGTH;
+    if (*max_element(codeLengths, codeLengths + 256) > limit) 
+    {
+        uint64_t unrestrictedBits = countEncodedBits(freqs, codeLengths);
+        if (limitCodeLengths(freqs, limit, codeLengths) != 0) 
+        {
+            cout << endl;
+            cout << "Error: Codes of at most " << limit << " bits cannot cover every byte in the input!" << endl;
+            cout << endl;
+            return 1;
+        }
+        uint64_t limitedBits = countEncodedBits(freqs, codeLengths);
+        cout << "Limited codes to " << limit << " bits, encoded size +" << 100.0 * (limitedBits - unrestrictedBits) / unrestrictedBits << "% vs unrestricted..." << endl;
+    }
+    else if (maxCodeLength > 0) 
+    {
+        cout << "Codes already fit in " << limit << " bits, encoded size +0% vs unrestricted..." << endl;
+    }
 
-    // write out
-    ofstream treeOut(treeJsonName, ifstream::binary);
-    if (!treeOut) 
+    // generate bit strings for each character
+    if (generateCodes(codeLengths, codes) != 0) 
     {
         cout << endl;
-        cout << "Error: Cannot write out!" << endl;
+        cout << "Error: Huffman codes are longer than " << MAX_CODE_LENGTH << " bits!" << endl;
         cout << endl;
         return 1;
     }
-    writeTreeJson(root, treeOut);
-    treeOut.close();
     return 0;
 }
 
 //
 // Write out encoded bits to binary file
+// The file is a container holding the code lengths and the whole content as a single block
 // Credit to answer in https://stackoverflow.com/questions/8329767/writing-into-binary-files
 //
-int writeEncodedBits(string& bitString, char* encodedBinName)
+int writeEncodedBits(BitWriter& writer, const uint8_t codeLengths[256], size_t contentSize, char* encodedBinName)
 {
     // open file
     ofstream binOut(encodedBinName, ifstream::binary);
@@ -121,34 +237,166 @@ int writeEncodedBits(string& bitString, char* encodedBinName)
         return 1;
     }
 
-    // first, we will write a 64-bit header indicating the total number of bits
-    uint64_t bits64 = static_cast<uint64_t>(bitString.size());
-    binOut.write(reinterpret_cast<const char*>(&bits64), sizeof(bits64));
+    // packed bytes, already padded with 0s to a whole byte
+    const vector<unsigned char>& bytes = writer.finish();
+
+    // first, the header: code lengths and the one block (none for an empty input)
+    vector<BlockEntry> blocks;
+    if (contentSize > 0) 
+    {
+        blocks.push_back({0, static_cast<uint64_t>(contentSize)});
+    }
+    writeContainerHeader(binOut, contentSize, codeLengths, blocks, static_cast<uint64_t>(bytes.size()) * 8);
+
+    // then the packed bytes (this is how we will also decode the binary file)
+    binOut.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+
+    binOut.close();
+    return 0;
+}
 
-    // then we write everything byte-by-byte (this is how we will also decode the binary file)
-    unsigned char currentByte = 0;
-    int bitCount = 0;
-    for (size_t i = 0; i < bitString.size(); i++) 
+//
+// Encode the input one block at a time and write each block out as soon as it is packed (streaming mode)
+// The block index is only known once every block is written, so a placeholder header of the same size
+// goes out first and is overwritten at the end. Memory use is one block of input plus its packed bits.
+//
+int encodeStreaming(const char* inputFileName, const CodeTable& codes, const uint8_t codeLengths[256], uint64_t blockSize, uint64_t contentSize, char* encodedBinName)
+{
+    // open files
+    ifstream infile(inputFileName, ifstream::binary);
+    if (!infile) 
     {
-        currentByte <<= 1;
-        if (bitString[i] == '1') 
+        cout << endl;
+        cout << "Error: Cannot open .txt file!" << endl;
+        cout << endl;
+        return 1;
+    }
+    ofstream binOut(encodedBinName, ifstream::binary);
+    if (!binOut) 
+    {
+        cout << endl;
+        cout << "Error: Cannot open binary file!" << endl;
+        cout << endl;
+        return 1;
+    }
+
+    // placeholder header, the same size as the real one
+    size_t blockCount = static_cast<size_t>((contentSize + blockSize - 1) / blockSize);
+    vector<BlockEntry> blocks(blockCount);
+    writeContainerHeader(binOut, blockSize, codeLengths, blocks, 0);
+
+    // read, pack and write each block, reusing the same buffers throughout
+    vector<unsigned char> buffer(static_cast<size_t>(min<uint64_t>(blockSize, contentSize)));
+    BitWriter writer;
+    uint64_t bitOffset = 0;
+    for (size_t b = 0; b < blockCount; b++) 
+    {
+        size_t length = static_cast<size_t>(min<uint64_t>(blockSize, contentSize - b * blockSize));
+        if (!infile.read(reinterpret_cast<char*>(buffer.data()), length)) 
         {
-            currentByte |= 1;
+            cout << endl;
+            cout << "Error: .txt file changed while it was being encoded!" << endl;
+            cout << endl;
+            return 1;
         }
-        bitCount++;
-        if (bitCount == 8) // write byte
+
+        writer.clear();
+        for (size_t i = 0; i < length; i++) 
         {
-            binOut.put(static_cast<char>(currentByte));
-            currentByte = 0;
-            bitCount = 0;
+            const HuffmanCode& code = codes[buffer[i]];
+            writer.putBits(code.bits, code.length);
         }
+        const vector<unsigned char>& bytes = writer.finish();
+        binOut.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+
+        blocks[b].bitOffset = bitOffset;
+        blocks[b].decodedLength = length;
+        bitOffset += static_cast<uint64_t>(bytes.size()) * 8;
+    }
+
+    // now the real header
+    binOut.seekp(0);
+    writeContainerHeader(binOut, blockSize, codeLengths, blocks, bitOffset);
+    if (!binOut) 
+    {
+        cout << endl;
+        cout << "Error: Failed to write binary file!" << endl;
+        cout << endl;
+        return 1;
+    }
+
+    binOut.close();
+    return 0;
+}
+
+//
+// Write the input out as it is, as an adaptive container whose blocks are all stored (for input coding would not shrink enough)
+// The blocks are copied straight from the mapped input, or in streaming mode read from the file one block at a time
+//
+int writeStored(const char* inputFileName, const unsigned char* content, uint64_t blockSize, uint64_t contentSize, char* encodedBinName)
+{
+    // open files (the input only in streaming mode, when it is not mapped)
+    ifstream infile;
+    if (!content) 
+    {
+        infile.open(inputFileName, ifstream::binary);
+        if (!infile) 
+        {
+            cout << endl;
+            cout << "Error: Cannot open .txt file!" << endl;
+            cout << endl;
+            return 1;
+        }
+    }
+    ofstream binOut(encodedBinName, ifstream::binary);
+    if (!binOut) 
+    {
+        cout << endl;
+        cout << "Error: Cannot open binary file!" << endl;
+        cout << endl;
+        return 1;
     }
 
-    // pad leftover bits with 0s
-    if (bitCount > 0) 
+    // a stored block is its bytes, so the whole index is known up front
+    size_t blockCount = static_cast<size_t>((contentSize + blockSize - 1) / blockSize);
+    vector<BlockEntry> blocks(blockCount);
+    for (size_t b = 0; b < blockCount; b++) 
     {
-        currentByte <<= (8 - bitCount);
-        binOut.put(static_cast<char>(currentByte));
+        blocks[b].bitOffset = b * blockSize * 8;
+        blocks[b].decodedLength = min<uint64_t>(blockSize, contentSize - b * blockSize);
+    }
+    BlockPlan plan;
+    planStored(blockCount, plan);
+    const uint8_t noCodeLengths[256] = {};
+    writeContainerHeader(binOut, blockSize, noCodeLengths, blocks, contentSize * 8, FLAG_ADAPTIVE, &plan.codings);
+
+    // then the bytes themselves
+    if (content) 
+    {
+        binOut.write(reinterpret_cast<const char*>(content), contentSize);
+    }
+    else 
+    {
+        vector<unsigned char> buffer(static_cast<size_t>(min<uint64_t>(blockSize, contentSize)));
+        for (size_t b = 0; b < blockCount; b++) 
+        {
+            size_t length = static_cast<size_t>(blocks[b].decodedLength);
+            if (!infile.read(reinterpret_cast<char*>(buffer.data()), length)) 
+            {
+                cout << endl;
+                cout << "Error: .txt file changed while it was being encoded!" << endl;
+                cout << endl;
+                return 1;
+            }
+            binOut.write(reinterpret_cast<const char*>(buffer.data()), length);
+        }
+    }
+    if (!binOut) 
+    {
+        cout << endl;
+        cout << "Error: Failed to write binary file!" << endl;
+        cout << endl;
+        return 1;
     }
 
     binOut.close();
@@ -157,70 +405,118 @@ int writeEncodedBits(string& bitString, char* encodedBinName)
 
 int main(int argc, char* argv[]) 
 {
-    // 1) Read command line arguments (returns default file "encoded_output.bin" and "tree.json")
+    // 1) Read command line arguments (returns default file "encoded_output.bin")
     char* inputFileName = nullptr;
-    char* treeJsonName = "tree.json";
     char* encodedBinName = "encoded_output.bin";
-    if (readArgs(argc, argv, inputFileName) != 0) 
+    bool streaming = false; // default whole file in memory
+    int mapHints = 0; // default no extra mapping hints
+    int maxCodeLength = 0; // default only capped at MAX_CODE_LENGTH
+    Stats::Format statsFormat = Stats::NONE; // default no stats
+    uint64_t blockSize = STREAM_BLOCK_SIZE;
+    double minSaving = DEFAULT_MIN_SAVING;
+    if (readArgs(argc, argv, inputFileName, streaming, blockSize, minSaving, mapHints, maxCodeLength, statsFormat) != 0) 
     {
         return 1;
     }
+    stats.enable("encode-sequential", statsFormat);
     cout << "Read arguments..." << endl;
 
-    // 2) Read input file
+    // 2) Map input file (streaming mode leaves it on disk and reads it in each pass)
     auto read_start = chrono::high_resolution_clock::now();
-    string content;
-    if (readInputFile(inputFileName, content) != 0) 
+    MappedFile input;
+    if (!streaming && readInputFile(inputFileName, input, mapHints) != 0) 
     {
         return 1;
     }
+    const unsigned char* content = input.data();
     auto read_end = chrono::high_resolution_clock::now();
     auto diff = read_end - read_start;
     auto duration = chrono::duration_cast<chrono::milliseconds>(diff);
     cout << "Read input file in " << duration.count() << " ms..." << endl;
+    stats.addStage("read", diff);
 
-    // 3) Build frequency map
+    // 3) Build frequency table
     auto build_start = chrono::high_resolution_clock::now();
-    unordered_map<char, int> freqMap = buildFrequencyMap(content);
+    uint64_t freqs[256];
+    uint64_t contentSize = input.size();
+    if (!streaming) 
+    {
+        buildFrequencyTable(content, contentSize, freqs);
+    }
+    else if (countInputFile(inputFileName, freqs, contentSize) != 0) 
+    {
+        return 1;
+    }
     auto build_end = chrono::high_resolution_clock::now();
     diff = build_end - build_start;
     duration = chrono::duration_cast<chrono::milliseconds>(diff);
-    cout << "Built frequency map in " << duration.count() << " ms..." << endl;
+    cout << "Built frequency table in " << duration.count() << " ms..." << endl;
+    stats.addStage("histogram", diff);
 
-    // 4) Build Huffman tree and get each character's corresponding bit string, and write out
+    // 4) Build Huffman tree and get each character's code length and corresponding bit string
+    //    Input that coding would not shrink by at least minSaving is stored as it is instead
     auto tree_start = chrono::high_resolution_clock::now();
-    unordered_map<char, string> codes;
-    if (buildHuffmanTree(freqMap, codes, treeJsonName) != 0) 
+    uint8_t codeLengths[256];
+    CodeTable codes;
+    if (buildHuffmanTree(freqs, maxCodeLength, codeLengths, codes) != 0) 
     {
         return 1;
     }
+    bool stored = storeInstead(singleTableBits(freqs, codeLengths), contentSize, minSaving);
     auto tree_end = chrono::high_resolution_clock::now();
     diff = tree_end - tree_start;
     duration = chrono::duration_cast<chrono::milliseconds>(diff);
     cout << "Built Huffman Tree in " << duration.count() << " ms..." << endl;
+    stats.addStage("tree", diff);
+    if (stored) 
+    {
+        cout << "Coding would save less than " << minSaving * 100 << "%, storing the input as is..." << endl;
+    }
 
-    // 5) Encode content into bits
+    // 5) Encode content into packed bits (streaming mode reads, encodes and writes one block at a time,
+    //    and stored input is copied straight out, in one block unless streaming mode has blocks anyway)
     auto encode_start = chrono::high_resolution_clock::now();
-    string bitString;
-    for (unsigned char uc : content) 
+    BitWriter writer;
+    if (stored) 
+    {
+        if (writeStored(inputFileName, streaming ? nullptr : content, streaming ? blockSize : contentSize, contentSize, encodedBinName) != 0) 
+        {
+            return 1;
+        }
+    }
+    else if (streaming) 
     {
-        bitString += codes[static_cast<char>(uc)];
+        if (encodeStreaming(inputFileName, codes, codeLengths, blockSize, contentSize, encodedBinName) != 0) 
+        {
+            return 1;
+        }
+    }
+    else 
+    {
+        writer.reserve(countEncodedBits(freqs, codeLengths));
+        for (size_t i = 0; i < contentSize; i++) 
+        {
+            const HuffmanCode& code = codes[content[i]];
+            writer.putBits(code.bits, code.length);
+        }
     }
     auto encode_end = chrono::high_resolution_clock::now();
     diff = encode_end - encode_start;
     duration = chrono::duration_cast<chrono::milliseconds>(diff);
     cout << "Encoded file in " << duration.count() << " ms..." << endl;
+    stats.addStage("encode", diff);
 
-    // 6) Write out to binary file
-    auto write_start = steady_clock::now();
-    if (writeEncodedBits(bitString, encodedBinName) != 0) 
+    // 6) Write out to binary file (streaming mode and stored input have already written it)
+    auto write_start = chrono::high_resolution_clock::now();
+    if (!streaming && !stored && writeEncodedBits(writer, codeLengths, contentSize, encodedBinName) != 0) 
     {
         return 1;
     }
-    auto write_end = steady_clock::now();
+    auto write_end = chrono::high_resolution_clock::now();
     diff = write_end - write_start;
     duration = chrono::duration_cast<chrono::milliseconds>(diff);
     cout << "Wrote file in " << duration.count() << " ms..." << endl;
+    stats.addStage("write", diff);
 
     // 7) Calculate % compression
     size_t originalSizeBytes = std::filesystem::file_size(inputFileName);
@@ -228,6 +524,18 @@ int main(int argc, char* argv[])
     double ratio = (double) encodedSizeBytes / originalSizeBytes;
     cout << "Compression %: " << ratio << endl;
 
+    // 8) Print timings and counters (only with --stats)
+    if (stats.enabled()) 
+    {
+        stats.setCounter("input_bytes", contentSize);
+        stats.setCounter("output_bytes", encodedSizeBytes);
+        stats.setCounter("encoded_bits", countEncodedBits(freqs, codeLengths));
+        stats.setCounter("distinct_bytes", count_if(codeLengths, codeLengths + 256, [](uint8_t length) { return length > 0; }));
+        stats.setCounter("max_code_length", *max_element(codeLengths, codeLengths + 256));
+        stats.setCounter("blocks", streaming ? (contentSize + blockSize - 1) / blockSize : 0);
+        stats.print(cerr);
+    }
+
     // done
     return 0;
 }
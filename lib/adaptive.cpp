@@ -0,0 +1,126 @@
+/* adaptive.cpp */
+
+//
+// Implementation of the per-block table choice
+//
+
+#include <algorithm>
+
+#include "adaptive.h"
+
+// bits it takes to code a block with `codeLengths`, UINT64_MAX if some byte in it has no code
+static uint64_t codedBits(const uint64_t counts[256], const uint8_t codeLengths[256])
+{
+    uint64_t bits = 0;
+    for (int c = 0; c < 256; c++)
+    {
+        if (counts[c] > 0 && codeLengths[c] == 0)
+        {
+            return UINT64_MAX;
+        }
+        bits += counts[c] * codeLengths[c];
+    }
+    return bits;
+}
+
+// would these bytes be better off stored?
+bool storeInstead(uint64_t codedBits, uint64_t length, double minSaving)
+{
+    double rawBits = static_cast<double>(length) * 8;
+    return length > 0 && static_cast<double>(codedBits) > rawBits - rawBits * minSaving;
+}
+
+// bits it takes to code everything with one table
+uint64_t singleTableBits(const uint64_t freqs[256], const uint8_t codeLengths[256])
+{
+    std::vector<unsigned char> tableBytes;
+    writeCodeLengths(codeLengths, tableBytes);
+    return countEncodedBits(freqs, codeLengths) + tableBytes.size() * 8;
+}
+
+// pick the cheapest coding for every block, in order
+int planBlocks(const Histogram* blockCounts, size_t blockCount, int maxCodeLength, bool interleaved, double minSaving, BlockPlan& plan)
+{
+    planStored(blockCount, plan);
+
+    // a coded block is padded to a whole byte, and an interleaved one starts with its stream sizes
+    const uint64_t codedOverhead = 7 + (interleaved ? (INTERLEAVED_STREAMS - 1) * 64 : 0);
+    int limit = (maxCodeLength > 0) ? maxCodeLength : MAX_CODE_LENGTH;
+    int current = BlockPlan::NO_TABLE;
+    HuffmanTree tree;
+    std::vector<unsigned char> tableBytes;
+    for (size_t b = 0; b < blockCount; b++)
+    {
+        const uint64_t* counts = blockCounts[b].counts;
+
+        // the best table for this block alone (an empty block has none, and is stored as nothing)
+        uint8_t codeLengths[256];
+        buildHuffmanTree(counts, tree);
+        computeCodeLengths(tree, codeLengths);
+        if (tree.empty())
+        {
+            continue;
+        }
+        if (*std::max_element(codeLengths, codeLengths + 256) > limit && limitCodeLengths(counts, limit, codeLengths) != 0)
+        {
+            return 1;
+        }
+
+        // what each choice costs, the new table's own bytes in the header included
+        tableBytes.clear();
+        writeCodeLengths(codeLengths, tableBytes);
+        uint64_t length = 0;
+        for (int c = 0; c < 256; c++)
+        {
+            length += counts[c];
+        }
+        uint64_t newBits = codedBits(counts, codeLengths) + tableBytes.size() * 8 + codedOverhead;
+        uint64_t reuseBits = (current == BlockPlan::NO_TABLE) ? UINT64_MAX : codedBits(counts, plan.codings.tables[current].data());
+        reuseBits = (reuseBits == UINT64_MAX) ? UINT64_MAX : reuseBits + codedOverhead;
+
+        // on a tie, reusing a table keeps the header smaller; storing wins unless coding saves enough
+        if (storeInstead(std::min(reuseBits, newBits), length, minSaving))
+        {
+            continue;
+        }
+        if (reuseBits <= newBits)
+        {
+            plan.codings.kinds[b] = BLOCK_REUSE;
+            plan.blockTable[b] = current;
+        }
+        else
+        {
+            plan.codings.kinds[b] = BLOCK_NEW_TABLE;
+            plan.codings.tables.emplace_back();
+            std::copy(codeLengths, codeLengths + 256, plan.codings.tables.back().begin());
+            current = static_cast<int>(plan.codings.tables.size()) - 1;
+            plan.blockTable[b] = current;
+        }
+    }
+    return 0;
+}
+
+// a plan that stores every block
+void planStored(size_t blockCount, BlockPlan& plan)
+{
+    plan.codings.kinds.assign(blockCount, BLOCK_STORED);
+    plan.codings.tables.clear();
+    plan.blockTable.assign(blockCount, BlockPlan::NO_TABLE);
+}
+
+// encode block `b` the way the plan says
+void encodePlannedBlock(const BlockPlan& plan, size_t b, const unsigned char* data, size_t length, bool interleaved, PlanCodes& codes, BitWriter& writer)
+{
+    int t = plan.blockTable[b];
+    if (t == BlockPlan::NO_TABLE)
+    {
+        writer.finish();
+        return;
+    }
+    if (codes.table != t)
+    {
+        generateCodes(plan.codings.tables[t].data(), codes.codes);
+        codes.table = t;
+    }
+    encodeBlock(data, length, codes.codes, interleaved, writer);
+}
@@ -0,0 +1,72 @@
+/* adaptive.h */
+
+//
+// Choosing a Huffman table per block, for inputs whose statistics change along the way,
+// and storing what coding would not make (much) smaller
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "bitwriter.h"
+#include "container.h"
+#include "histogram.h"
+#include "huffman.h"
+
+/// <summary>
+/// A BlockPlan is how planBlocks decided to code each block of an adaptive
+/// container: the codings that go into its header, and which of their tables
+/// each block is encoded with. Blocks only depend on the plan, so once it is
+/// made they can be encoded (and later decoded) side by side. The plan holds
+/// nothing but code lengths; the code tables are built by whoever encodes the
+/// blocks (see PlanCodes).
+/// </summary>
+struct BlockPlan {
+    static constexpr int NO_TABLE = -1;
+
+    BlockCodings codings;
+    std::vector<int> blockTable; // index into codings.tables for each block, NO_TABLE for a stored block
+
+    // is block `b` stored as it is? (its bytes are then written straight from the input, see encodePlannedBlock)
+    bool stored(size_t b) const { return blockTable[b] == NO_TABLE; }
+};
+
+/// <summary>
+/// PlanCodes are the code table of one of a plan's tables, built when a block
+/// first needs it and kept while the blocks after it reuse that table. Every
+/// thread that encodes planned blocks has its own.
+/// </summary>
+struct PlanCodes {
+    int table = BlockPlan::NO_TABLE; // the table `codes` were built from
+    CodeTable codes;
+};
+
+// store instead of coding unless coding saves at least this much of the raw size, by default
+const double DEFAULT_MIN_SAVING = 0.01;
+
+// smallest block size adaptive encoding accepts: every block is counted into a Histogram of its own
+// before it is planned, and a smaller block could hardly ever pay for a table anyway
+const uint64_t MIN_ADAPTIVE_BLOCK_SIZE = 4096;
+
+// would `length` bytes that code to `codedBits` (tables included) be better off stored, given that
+// coding has to save at least `minSaving` (0 to 1) of their raw size to be worth decoding?
+bool storeInstead(uint64_t codedBits, uint64_t length, double minSaving);
+
+// bits it takes to code everything counted in `freqs` with the one table `codeLengths`, its bytes in the header included
+uint64_t singleTableBits(const uint64_t freqs[256], const uint8_t codeLengths[256]);
+
+// Walk the blocks in order and, from each block's byte counts, pick whichever is cheapest: coding it with
+// the table in use, with a new table fitted to it (paying for the table in the header), or storing it
+// (which wins unless coding saves at least `minSaving` of the block)
+// returns 0 on success, 1 if `maxCodeLength` bits (0 for MAX_CODE_LENGTH) cannot cover the bytes of some block
+int planBlocks(const Histogram* blockCounts, size_t blockCount, int maxCodeLength, bool interleaved, double minSaving, BlockPlan& plan);
+
+// a plan that stores every block as it is, for input that one table would not make small enough
+void planStored(size_t blockCount, BlockPlan& plan);
+
+// encode block `b` into `writer` the way the plan says and finish it, building its table into `codes` unless they already hold it
+// (a stored block is left out: it is its input as it is, which the caller writes out from where it already is)
+void encodePlannedBlock(const BlockPlan& plan, size_t b, const unsigned char* data, size_t length, bool interleaved, PlanCodes& codes, BitWriter& writer);
@@ -0,0 +1,104 @@
+/* batch.cpp */
+
+//
+// Implementation of the batch file list
+//
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <set>
+
+#include "batch.h"
+
+namespace fs = std::filesystem;
+
+// the inputs named by a directory or a list file
+int listInputs(const char* listOrDir, std::vector<std::string>& inputs)
+{
+    std::error_code error;
+    if (fs::is_directory(listOrDir, error))
+    {
+        for (const fs::directory_entry& entry : fs::directory_iterator(listOrDir, error))
+        {
+            if (entry.is_regular_file(error))
+            {
+                inputs.push_back(entry.path().string());
+            }
+        }
+        std::sort(inputs.begin(), inputs.end());
+        return error ? 1 : 0;
+    }
+
+    std::ifstream list(listOrDir);
+    if (!list)
+    {
+        return 1;
+    }
+    std::string line;
+    while (std::getline(list, line))
+    {
+        // tolerate lists written on Windows
+        if (!line.empty() && line.back() == '\r')
+        {
+            line.pop_back();
+        }
+        if (!line.empty())
+        {
+            inputs.push_back(line);
+        }
+    }
+    return 0;
+}
+
+// list the files named by `listOrDir` with their outputs in `outDir`
+int listBatch(const char* listOrDir, const char* outDir, const std::string& strip, const std::string& add, std::vector<BatchFile>& files)
+{
+    std::vector<std::string> inputs;
+    if (listInputs(listOrDir, inputs) != 0)
+    {
+        std::cout << std::endl;
+        std::cout << "Error: Cannot read batch list or directory " << listOrDir << "!" << std::endl;
+        std::cout << std::endl;
+        return 1;
+    }
+
+    std::error_code error;
+    fs::create_directories(outDir, error);
+    if (!fs::is_directory(outDir, error))
+    {
+        std::cout << std::endl;
+        std::cout << "Error: Cannot create output directory " << outDir << "!" << std::endl;
+        std::cout << std::endl;
+        return 1;
+    }
+
+    std::set<std::string> outputs;
+    files.clear();
+    for (const std::string& input : inputs)
+    {
+        uint64_t size = fs::file_size(input, error);
+        if (error)
+        {
+            std::cout << std::endl;
+            std::cout << "Error: Cannot open " << input << "!" << std::endl;
+            std::cout << std::endl;
+            return 1;
+        }
+
+        std::string name = fs::path(input).filename().string();
+        bool stripped = !strip.empty() && name.size() > strip.size() && name.compare(name.size() - strip.size(), strip.size(), strip) == 0;
+        name = stripped ? name.substr(0, name.size() - strip.size()) : name + add;
+        std::string output = (fs::path(outDir) / name).string();
+        if (!outputs.insert(output).second)
+        {
+            std::cout << std::endl;
+            std::cout << "Error: Two inputs would both be written to " << output << "!" << std::endl;
+            std::cout << std::endl;
+            return 1;
+        }
+        files.push_back({input, output, size});
+    }
+    return 0;
+}
@@ -0,0 +1,32 @@
+/* batch.h */
+
+//
+// The list of files handled by one batch run (--batch)
+//
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/// <summary>
+/// A BatchFile is one input of a batch run, its size, and the file its
+/// result is written to. All outputs go into one directory and are named
+/// after their input: `strip` is taken off the input's name if it ends in
+/// it, otherwise `add` is appended (e.g. notes.txt -> notes.txt.bin when
+/// encoding, notes.txt.bin -> notes.txt when decoding).
+/// </summary>
+struct BatchFile {
+    std::string input;
+    std::string output;
+    uint64_t size;
+};
+
+// the files named by `listOrDir`: every regular file in a directory, in name order, or every line of a list file
+// returns 0 on success, 1 if the directory or list cannot be read
+int listInputs(const char* listOrDir, std::vector<std::string>& inputs);
+
+// list the files named by `listOrDir` (see listInputs) with their outputs in `outDir`, which is created if needed
+// returns 0 on success, 1 (after saying why) if an input cannot be read or two inputs would share an output
+int listBatch(const char* listOrDir, const char* outDir, const std::string& strip, const std::string& add, std::vector<BatchFile>& files);
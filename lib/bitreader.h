@@ -0,0 +1,68 @@
+/* bitreader.h */
+
+//
+// Reads packed Huffman bits straight out of a byte buffer
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+/// <summary>
+/// A BitReader walks an MSB-first bitstream in place, without expanding it.
+/// peek() returns the next bits from a 64-bit window loaded at the current
+/// position; near the end of the buffer the window is filled with 0s instead
+/// of reading past it, so it is safe to use over a memory-mapped file.
+/// </summary>
+class BitReader {
+public:
+    BitReader(const unsigned char* data, size_t size, uint64_t totalBits)
+        : data(data), size(size), totalBits(totalBits), pos(0) {}
+
+    // the next `count` bits (1 to 57) without consuming them
+    uint32_t peek(int count) const
+    {
+        return static_cast<uint32_t>(window() >> (64 - count));
+    }
+
+    // skip over `count` bits
+    void consume(int count) { pos += count; }
+
+    uint64_t position() const { return pos; }
+    void seek(uint64_t bitPos) { pos = bitPos; }
+
+    // bits left before the end of the stream (0 once past it)
+    uint64_t bitsLeft() const { return pos < totalBits ? totalBits - pos : 0; }
+
+private:
+    // 64 bits starting at pos, MSB-first
+    uint64_t window() const
+    {
+        size_t byte = static_cast<size_t>(pos >> 3);
+        uint64_t word = 0;
+        if (byte + 8 <= size)
+        {
+            std::memcpy(&word, data + byte, sizeof(word));
+            word = __builtin_bswap64(word);
+        }
+        else
+        {
+            // last few bytes: pad with 0s instead of reading past the buffer
+            for (int i = 0; i < 8; i++)
+            {
+                word <<= 8;
+                if (byte + i < size)
+                {
+                    word |= data[byte + i];
+                }
+            }
+        }
+        return word << (pos & 7);
+    }
+
+    const unsigned char* data;
+    size_t size;
+    uint64_t totalBits;
+    uint64_t pos;
+};
@@ -0,0 +1,166 @@
+/* bitwriter.cpp */
+
+//
+// Implementation of the packed bit writer
+//
+
+#include <limits>
+
+#include "bitwriter.h"
+
+BitWriter::BitWriter()
+    : acc(0), accBits(0), paddingBits(0), headBits(0), totalBytes(0), capacity(0), out(nullptr) {}
+
+// write into `target` (which must have room for every bit), starting at bit `startBit`
+BitWriter::BitWriter(unsigned char* target, uint64_t startBit)
+    : acc(0), accBits(static_cast<int>(startBit % 8)), paddingBits(0), headBits(static_cast<int>(startBit % 8)),
+      totalBytes(0), capacity(std::numeric_limits<size_t>::max()), out(target + startBit / 8) {}
+
+// reserve room for a known number of bits up front
+void BitWriter::reserve(uint64_t bits)
+{
+    // round up to whole words so flushWord never has to grow
+    size_t words = static_cast<size_t>((bits + 63) / 64);
+    if (words * 8 > bytes.size())
+    {
+        bytes.resize(words * 8);
+        out = bytes.data();
+        capacity = bytes.size();
+    }
+}
+
+// start over with no bits, keeping the buffer for reuse (owned buffer only)
+void BitWriter::clear()
+{
+    acc = 0;
+    accBits = 0;
+    paddingBits = 0;
+    headBits = 0;
+    totalBytes = 0;
+
+    // finish() trimmed the buffer, but its storage is still there
+    bytes.resize(bytes.capacity());
+    out = bytes.data();
+    capacity = bytes.size();
+}
+
+// append whole bytes, the writer must be on a byte boundary
+void BitWriter::putBytes(const unsigned char* data, size_t count)
+{
+    // move the pending whole bytes out of the accumulator first
+    int pendingBytes = accBits / 8;
+    while (totalBytes + pendingBytes + count > capacity)
+    {
+        grow();
+    }
+    for (int i = 0; i < pendingBytes; i++)
+    {
+        out[totalBytes++] = static_cast<unsigned char>(acc >> (accBits - 8 * (i + 1)));
+    }
+    acc = 0;
+    accBits = 0;
+
+    if (count > 0)
+    {
+        std::memcpy(out + totalBytes, data, count);
+        totalBytes += count;
+    }
+}
+
+// double the buffer when a word does not fit
+void BitWriter::grow()
+{
+    size_t newSize = bytes.size() < 4096 ? 4096 : bytes.size() * 2;
+    bytes.resize(newSize);
+    out = bytes.data();
+    capacity = bytes.size();
+}
+
+// flush the leftover bits (padded with 0s) and return the packed bytes
+const std::vector<unsigned char>& BitWriter::finish()
+{
+    // pad leftover bits with 0s up to the next byte
+    int leftoverBytes = (accBits + 7) / 8;
+    if (totalBytes + leftoverBytes > bytes.size())
+    {
+        grow();
+    }
+    uint64_t word = (accBits == 0) ? 0 : acc << (64 - accBits);
+    for (int i = 0; i < leftoverBytes; i++)
+    {
+        out[totalBytes++] = static_cast<unsigned char>(word >> (56 - 8 * i));
+    }
+    paddingBits = leftoverBytes * 8 - accBits;
+    acc = 0;
+    accBits = 0;
+
+    // trim to what was actually written
+    bytes.resize(totalBytes);
+    capacity = bytes.size();
+    return bytes;
+}
+
+// caller-owned buffer only: store every whole byte and return the last partial one
+unsigned char BitWriter::finishShared()
+{
+    // whole bytes are ours alone
+    int wholeBytes = accBits / 8;
+    int partialBits = accBits % 8;
+    uint64_t word = (accBits == 0) ? 0 : acc << (64 - accBits);
+    for (int i = 0; i < wholeBytes; i++)
+    {
+        out[totalBytes++] = static_cast<unsigned char>(word >> (56 - 8 * i));
+    }
+
+    // the partial byte is shared with whoever writes the next range
+    unsigned char partial = (partialBits == 0) ? 0 : static_cast<unsigned char>(word >> (56 - 8 * wholeBytes));
+    paddingBits = (partialBits == 0) ? 0 : 8 - partialBits;
+    totalBytes += (partialBits == 0) ? 0 : 1;
+    acc = 0;
+    accBits = 0;
+    return partial;
+}
+
+// encode one container block into `writer` and finish it
+// With interleaving, consecutive bytes go to different streams, each with its own accumulator, so the
+// putBits calls of one round do not wait on each other and the CPU can overlap them
+void encodeBlock(const unsigned char* data, size_t length, const CodeTable& codes, bool interleaved, BitWriter& writer)
+{
+    if (!interleaved) {
+        for (size_t i = 0; i < length; ++i) {
+            const HuffmanCode& code = codes[data[i]];
+            writer.putBits(code.bits, code.length);
+        }
+        writer.finish();
+        return;
+    }
+
+    // one round codes a byte into each stream
+    BitWriter streams[INTERLEAVED_STREAMS];
+    size_t i = 0;
+    for (; i + INTERLEAVED_STREAMS <= length; i += INTERLEAVED_STREAMS) {
+        const HuffmanCode& code0 = codes[data[i]];
+        const HuffmanCode& code1 = codes[data[i + 1]];
+        const HuffmanCode& code2 = codes[data[i + 2]];
+        const HuffmanCode& code3 = codes[data[i + 3]];
+        streams[0].putBits(code0.bits, code0.length);
+        streams[1].putBits(code1.bits, code1.length);
+        streams[2].putBits(code2.bits, code2.length);
+        streams[3].putBits(code3.bits, code3.length);
+    }
+    for (int s = 0; i < length; ++i, ++s) {
+        const HuffmanCode& code = codes[data[i]];
+        streams[s].putBits(code.bits, code.length);
+    }
+
+    // the sizes of all streams but the last, then the streams themselves
+    for (int s = 0; s + 1 < INTERLEAVED_STREAMS; ++s) {
+        uint64_t streamBytes = streams[s].finish().size();
+        writer.putBytes(reinterpret_cast<const unsigned char*>(&streamBytes), sizeof(streamBytes));
+    }
+    for (BitWriter& stream : streams) {
+        const std::vector<unsigned char>& bytes = stream.finish();
+        writer.putBytes(bytes.data(), bytes.size());
+    }
+    writer.finish();
+}
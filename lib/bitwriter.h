@@ -0,0 +1,118 @@
+/* bitwriter.h */
+
+//
+// Packs Huffman codes into bytes through a 64-bit accumulator
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "container.h"
+#include "huffman.h"
+
+/// <summary>
+/// A BitWriter collects bits most-significant-bit first, the same order
+/// the decoder reads them back in. Bits are shifted into a 64-bit
+/// accumulator and only whole words are flushed into the byte buffer,
+/// so the output never exists as a string of '0'/'1' characters.
+///
+/// By default the writer owns a growing buffer. It can instead write into a
+/// caller-owned buffer starting at any bit offset, which lets several threads
+/// fill in their own ranges of one shared output. In that mode the bytes on
+/// either side of the range may be shared with a neighbour, so the first byte
+/// is written with 0s in the neighbour's bits and the last partial byte is
+/// handed back by finishShared() instead of being stored.
+/// </summary>
+class BitWriter {
+public:
+    BitWriter();
+
+    // write into `target` (which must have room for every bit), starting at bit `startBit`
+    BitWriter(unsigned char* target, uint64_t startBit);
+
+    BitWriter(const BitWriter&) = delete;
+    BitWriter& operator=(const BitWriter&) = delete;
+    BitWriter(BitWriter&&) = default;
+    BitWriter& operator=(BitWriter&&) = default;
+
+    // reserve room for a known number of bits up front
+    void reserve(uint64_t bits);
+
+    // start over with no bits, keeping the buffer for reuse (owned buffer only)
+    void clear();
+
+    // append a single bit
+    void putBit(int bit)
+    {
+        acc = (acc << 1) | static_cast<uint64_t>(bit & 1);
+        if (++accBits == 64)
+        {
+            flushWord();
+        }
+    }
+
+    // append the low `length` bits of `bits` (1 to 64 bits, upper bits must be 0)
+    void putBits(uint64_t bits, int length)
+    {
+        int room = 64 - accBits;
+        if (length < room)
+        {
+            acc = (acc << length) | bits;
+            accBits += length;
+            return;
+        }
+
+        // top up the accumulator, flush it, and keep whatever is left over
+        int rest = length - room;
+        acc = (room == 64) ? bits : (acc << room) | (bits >> rest);
+        flushWord();
+        acc = (rest == 0) ? 0 : bits & ((1ULL << rest) - 1);
+        accBits = rest;
+    }
+
+    // append whole bytes, the writer must be on a byte boundary
+    void putBytes(const unsigned char* data, size_t count);
+
+    // total number of bits written so far
+    uint64_t bitCount() const { return totalBytes * 8 + accBits - paddingBits - headBits; }
+
+    // flush the leftover bits (padded with 0s) and return the packed bytes
+    const std::vector<unsigned char>& finish();
+
+    // caller-owned buffer only: store every whole byte and return the last partial one
+    // (0 if the range ends on a byte boundary) for the caller to OR into the shared buffer
+    unsigned char finishShared();
+
+private:
+    // write the full accumulator to the buffer in big-endian order
+    void flushWord()
+    {
+        if (totalBytes + 8 > capacity)
+        {
+            grow();
+        }
+        uint64_t word = __builtin_bswap64(acc);
+        std::memcpy(out + totalBytes, &word, sizeof(word));
+        totalBytes += 8;
+        acc = 0;
+        accBits = 0;
+    }
+
+    void grow();
+
+    uint64_t acc;                     // pending bits, right-aligned
+    int accBits;                      // number of pending bits in acc
+    int paddingBits;                  // 0s added by finish() to reach a whole byte
+    int headBits;                     // 0s standing in for a neighbour's bits in the first byte
+    size_t totalBytes;                // bytes flushed into the buffer
+    size_t capacity;                  // bytes the buffer can hold
+    unsigned char* out;               // where flushed bytes go (bytes.data() unless caller-owned)
+    std::vector<unsigned char> bytes; // packed output, when the writer owns its buffer
+};
+
+// encode data[0, length) as one container block into `writer` and finish it, either as a single stream
+// or as INTERLEAVED_STREAMS interleaved streams behind their sizes (see container.h)
+void encodeBlock(const unsigned char* data, size_t length, const CodeTable& codes, bool interleaved, BitWriter& writer);
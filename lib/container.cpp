@@ -0,0 +1,284 @@
+/* container.cpp */
+
+//
+// Reading and writing container headers
+//
+
+#include "container.h"
+
+// assign canonical Huffman codes from code lengths: shorter codes first, ties in byte order
+// Credit to RFC 1951 section 3.2.2 for the algorithm
+int assignCanonicalCodes(const uint8_t codeLengths[256], uint64_t codes[256])
+{
+    // how many codes of each length
+    uint64_t lengthCount[MAX_CODE_LENGTH + 1] = {};
+    for (int c = 0; c < 256; c++)
+    {
+        if (codeLengths[c] > MAX_CODE_LENGTH)
+        {
+            return 1;
+        }
+        lengthCount[codeLengths[c]]++;
+    }
+    lengthCount[0] = 0;
+
+    // make sure the lengths leave room for every code (Kraft inequality)
+    // once more than 256 codes are free at some length they can never run out, so stop counting there
+    uint64_t available = 1;
+    for (int len = 1; len <= MAX_CODE_LENGTH; len++)
+    {
+        available = (available > 256) ? available : available * 2;
+        if (lengthCount[len] > available)
+        {
+            return 1;
+        }
+        available -= lengthCount[len];
+    }
+
+    // first code of each length
+    uint64_t nextCode[MAX_CODE_LENGTH + 1] = {};
+    uint64_t code = 0;
+    for (int len = 1; len <= MAX_CODE_LENGTH; len++)
+    {
+        code = (code + lengthCount[len - 1]) << 1;
+        nextCode[len] = code;
+    }
+
+    // hand them out in byte order
+    for (int c = 0; c < 256; c++)
+    {
+        codes[c] = (codeLengths[c] == 0) ? 0 : nextCode[codeLengths[c]]++;
+    }
+    return 0;
+}
+
+// Small inputs use only a few byte values, so the lengths are stored as
+// (byte, length) pairs when that is shorter than one length per byte value:
+//     uint16 count of byte values that appear
+//     count <= 128: count x {uint8 byte, uint8 length}
+//     otherwise:    256 x uint8 length
+static const int PAIR_LIMIT = 128;
+
+// append the compact form of 256 code lengths (0 = byte never appears) to `out`
+void writeCodeLengths(const uint8_t codeLengths[256], std::vector<unsigned char>& out)
+{
+    int count = 0;
+    for (int c = 0; c < 256; c++)
+    {
+        count += (codeLengths[c] != 0);
+    }
+    out.push_back(static_cast<unsigned char>(count & 0xff));
+    out.push_back(static_cast<unsigned char>(count >> 8));
+
+    if (count <= PAIR_LIMIT)
+    {
+        for (int c = 0; c < 256; c++)
+        {
+            if (codeLengths[c] != 0)
+            {
+                out.push_back(static_cast<unsigned char>(c));
+                out.push_back(codeLengths[c]);
+            }
+        }
+    }
+    else
+    {
+        out.insert(out.end(), codeLengths, codeLengths + 256);
+    }
+}
+
+// read code lengths written by writeCodeLengths, returns the bytes used or 0 if malformed
+size_t readCodeLengths(const unsigned char* data, size_t size, uint8_t codeLengths[256])
+{
+    std::memset(codeLengths, 0, 256);
+    if (size < 2)
+    {
+        return 0;
+    }
+    int count = data[0] | (data[1] << 8);
+    if (count > 256)
+    {
+        return 0;
+    }
+
+    if (count <= PAIR_LIMIT)
+    {
+        size_t used = 2 + 2 * static_cast<size_t>(count);
+        if (size < used)
+        {
+            return 0;
+        }
+        for (int i = 0; i < count; i++)
+        {
+            codeLengths[data[2 + 2 * i]] = data[3 + 2 * i];
+        }
+        return used;
+    }
+
+    if (size < 2 + 256)
+    {
+        return 0;
+    }
+    std::memcpy(codeLengths, data + 2, 256);
+    return 2 + 256;
+}
+
+// id of a set of code lengths (FNV-1a over the 256 lengths)
+uint64_t codeLengthsId(const uint8_t codeLengths[256])
+{
+    uint64_t id = 0xcbf29ce484222325ULL;
+    for (int c = 0; c < 256; c++)
+    {
+        id = (id ^ codeLengths[c]) * 0x100000001b3ULL;
+    }
+    return id;
+}
+
+// write everything that precedes the payload onto the end of a buffer
+void writeContainerHeader(std::vector<unsigned char>& out, uint64_t blockSize, const uint8_t codeLengths[256], const std::vector<BlockEntry>& blocks, uint64_t totalBits, uint32_t flags, const BlockCodings* codings)
+{
+    ContainerHeader header = {};
+    std::memcpy(header.magic, CONTAINER_MAGIC, sizeof(header.magic));
+    header.version = (flags == 0) ? 2 : 3; // decoders that predate flags can still read files without any
+    header.flags = flags;
+    header.blockSize = blockSize;
+    header.blockCount = blocks.size();
+    header.totalBits = totalBits;
+
+    const unsigned char* headerBytes = reinterpret_cast<const unsigned char*>(&header);
+    out.insert(out.end(), headerBytes, headerBytes + sizeof(header));
+    if (flags & FLAG_SHARED_MODEL)
+    {
+        uint64_t id = codeLengthsId(codeLengths);
+        const unsigned char* idBytes = reinterpret_cast<const unsigned char*>(&id);
+        out.insert(out.end(), idBytes, idBytes + sizeof(id));
+    }
+    else
+    {
+        writeCodeLengths(codeLengths, out);
+    }
+    const unsigned char* blockBytes = reinterpret_cast<const unsigned char*>(blocks.data());
+    out.insert(out.end(), blockBytes, blockBytes + blocks.size() * sizeof(BlockEntry));
+    if ((flags & FLAG_ADAPTIVE) && codings)
+    {
+        out.insert(out.end(), codings->kinds.begin(), codings->kinds.end());
+        for (const std::array<uint8_t, 256>& table : codings->tables)
+        {
+            writeCodeLengths(table.data(), out);
+        }
+    }
+}
+
+// write everything that precedes the payload
+void writeContainerHeader(std::ostream& os, uint64_t blockSize, const uint8_t codeLengths[256], const std::vector<BlockEntry>& blocks, uint64_t totalBits, uint32_t flags, const BlockCodings* codings)
+{
+    std::vector<unsigned char> bytes;
+    writeContainerHeader(bytes, blockSize, codeLengths, blocks, totalBits, flags, codings);
+    os.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+}
+
+// parse everything that precedes the payload, returns 0 on success and 1 if malformed
+int readContainerHeader(const unsigned char* data, size_t size, ContainerHeader& header, uint8_t codeLengths[256], uint64_t& modelId, std::vector<BlockEntry>& blocks, BlockCodings& codings, size_t& payloadOffset)
+{
+    if (!isContainer(data, size))
+    {
+        return 1;
+    }
+    std::memcpy(&header, data, sizeof(header));
+    if (header.version < 1 || header.version > CONTAINER_VERSION)
+    {
+        return 1;
+    }
+    if (header.version < 3 ? header.flags != 0 : (header.flags & ~KNOWN_FLAGS) != 0)
+    {
+        return 1;
+    }
+    if ((header.flags & FLAG_SHARED_MODEL) && (header.flags & FLAG_ADAPTIVE))
+    {
+        return 1;
+    }
+    size_t offset = sizeof(header);
+
+    // code lengths, or the id of the model that has them
+    std::memset(codeLengths, 0, 256);
+    modelId = 0;
+    if (header.flags & FLAG_SHARED_MODEL)
+    {
+        if (size - offset < sizeof(modelId))
+        {
+            return 1;
+        }
+        std::memcpy(&modelId, data + offset, sizeof(modelId));
+        offset += sizeof(modelId);
+    }
+    else if (header.version >= 2)
+    {
+        size_t used = readCodeLengths(data + offset, size - offset, codeLengths);
+        if (used == 0)
+        {
+            return 1;
+        }
+        offset += used;
+    }
+
+    // block index
+    if (header.blockCount > (size - offset) / sizeof(BlockEntry))
+    {
+        return 1;
+    }
+    blocks.resize(header.blockCount);
+    if (header.blockCount > 0)
+    {
+        std::memcpy(blocks.data(), data + offset, blocks.size() * sizeof(BlockEntry));
+    }
+    offset += blocks.size() * sizeof(BlockEntry);
+
+    // how each block is coded (adaptive containers only), a block can only reuse a table that came before it
+    codings.kinds.clear();
+    codings.tables.clear();
+    if (header.flags & FLAG_ADAPTIVE)
+    {
+        if (header.blockCount > size - offset)
+        {
+            return 1;
+        }
+        codings.kinds.assign(data + offset, data + offset + blocks.size());
+        offset += blocks.size();
+        for (uint8_t kind : codings.kinds)
+        {
+            if (kind > BLOCK_STORED || (kind == BLOCK_REUSE && codings.tables.empty()))
+            {
+                return 1;
+            }
+            if (kind == BLOCK_NEW_TABLE)
+            {
+                codings.tables.emplace_back();
+                size_t used = readCodeLengths(data + offset, size - offset, codings.tables.back().data());
+                if (used == 0)
+                {
+                    return 1;
+                }
+                offset += used;
+            }
+        }
+    }
+
+    // payload has to hold every bit the header promises, and blocks must not overlap
+    // every symbol takes at least one bit, so a block cannot decode to more bytes than it has bits
+    // (this keeps a corrupt index from making a decoder allocate or create an absurdly large output)
+    if (header.totalBits > static_cast<uint64_t>(size - offset) * 8)
+    {
+        return 1;
+    }
+    for (size_t i = 0; i < blocks.size(); i++)
+    {
+        uint64_t blockEnd = (i + 1 < blocks.size()) ? blocks[i + 1].bitOffset : header.totalBits;
+        if (blocks[i].bitOffset > blockEnd || blocks[i].decodedLength > blockEnd - blocks[i].bitOffset)
+        {
+            return 1;
+        }
+    }
+
+    payloadOffset = offset;
+    return 0;
+}
@@ -0,0 +1,122 @@
+/* container.h */
+
+//
+// On-disk layout of a container (.bin holding the code lengths and independently decodable blocks)
+//
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <vector>
+
+/// <summary>
+/// A container is laid out as
+///     ContainerHeader
+///     code lengths (see writeCodeLengths, version 2 and up)
+///     BlockEntry[blockCount]
+///     payload (every block's bits, MSB-first, each block starting on a whole byte)
+/// The code lengths are all the decoder needs to rebuild the canonical Huffman
+/// codes, so no tree file travels with the output. Each block is encoded from
+/// scratch, so it can be decoded without knowing anything about the blocks
+/// before it. A file written as one continuous stream is simply one block.
+///
+/// With FLAG_INTERLEAVED set, byte i of every block is coded into stream
+/// i % INTERLEAVED_STREAMS instead, so the streams can be encoded and decoded
+/// side by side. Such a block starts with the byte sizes of all streams but the
+/// last (uint64_t each), followed by the streams, each starting on a whole byte.
+/// The last stream runs to the end of the block.
+///
+/// With FLAG_SHARED_MODEL set, the code lengths are those of a model trained
+/// beforehand (see model.h), and only its id (uint64_t) is stored in their place.
+///
+/// With FLAG_ADAPTIVE set, every block picks its own coding (see BlockCodings)
+/// instead: the code lengths above are left empty, and the block index is
+/// followed by one BLOCK_* kind byte per block, then the code lengths of each
+/// block that brings a new table, in block order. A stored block is its bytes
+/// as they are.
+///
+/// Version 1 containers had no code lengths and were decoded with a tree.json.
+/// Version 3 added the flags; a container without flags is still written as version 2.
+///
+/// A legacy .bin starts with its 64-bit bit count instead. The magic below read
+/// as that count would mean petabytes of data, so the two can never be confused.
+/// </summary>
+const char CONTAINER_MAGIC[8] = {'H', 'C', 'B', 'L', 'O', 'C', 'K', 'S'};
+const uint32_t CONTAINER_VERSION = 3;
+
+// header flags
+const uint32_t FLAG_INTERLEAVED = 1;
+const uint32_t FLAG_SHARED_MODEL = 2;
+const uint32_t FLAG_ADAPTIVE = 4;
+const uint32_t KNOWN_FLAGS = FLAG_INTERLEAVED | FLAG_SHARED_MODEL | FLAG_ADAPTIVE;
+
+// streams per block when FLAG_INTERLEAVED is set
+const int INTERLEAVED_STREAMS = 4;
+
+struct ContainerHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;       // FLAG_* bits (version 3 and up)
+    uint64_t blockSize;   // input bytes per block (the last block may be shorter)
+    uint64_t blockCount;
+    uint64_t totalBits;   // size of the payload in bits, padding included
+};
+
+struct BlockEntry {
+    uint64_t bitOffset;     // where the block starts in the payload
+    uint64_t decodedLength; // number of bytes the block decodes to
+};
+
+// how a block of an adaptive container is coded
+const uint8_t BLOCK_REUSE = 0;     // with the table of the last block that brought one
+const uint8_t BLOCK_NEW_TABLE = 1; // with a table of its own
+const uint8_t BLOCK_STORED = 2;    // not at all
+
+/// <summary>
+/// BlockCodings is the part of an adaptive container's header that says how
+/// each block is coded. Blocks that reuse a table name no table of their own,
+/// so a run of blocks with the same statistics pays for its table once.
+/// </summary>
+struct BlockCodings {
+    std::vector<uint8_t> kinds;                   // BLOCK_* of every block
+    std::vector<std::array<uint8_t, 256>> tables; // code lengths of every BLOCK_NEW_TABLE block, in block order
+};
+
+static_assert(sizeof(ContainerHeader) == 40, "ContainerHeader must not be padded");
+static_assert(sizeof(BlockEntry) == 16, "BlockEntry must not be padded");
+
+// does this data start with a container header?
+inline bool isContainer(const unsigned char* data, size_t size)
+{
+    return size >= sizeof(ContainerHeader) && std::memcmp(data, CONTAINER_MAGIC, sizeof(CONTAINER_MAGIC)) == 0;
+}
+
+// longest code the format allows (codes are handled as 64-bit integers)
+const int MAX_CODE_LENGTH = 64;
+
+// assign canonical Huffman codes from code lengths: shorter codes first, ties in byte order
+// returns 0 on success, 1 if the lengths are too long or cannot form a prefix code
+int assignCanonicalCodes(const uint8_t codeLengths[256], uint64_t codes[256]);
+
+// append the compact form of 256 code lengths (0 = byte never appears) to `out`
+void writeCodeLengths(const uint8_t codeLengths[256], std::vector<unsigned char>& out);
+
+// read code lengths written by writeCodeLengths, returns the bytes used or 0 if malformed
+size_t readCodeLengths(const unsigned char* data, size_t size, uint8_t codeLengths[256]);
+
+// id of a set of code lengths, which is how a container names the shared model it was encoded against
+uint64_t codeLengthsId(const uint8_t codeLengths[256]);
+
+// write everything that precedes the payload, to a stream or onto the end of a buffer
+// (with FLAG_SHARED_MODEL in `flags`, only the id of `codeLengths` is written; with FLAG_ADAPTIVE, `codings` follow the index)
+void writeContainerHeader(std::ostream& os, uint64_t blockSize, const uint8_t codeLengths[256], const std::vector<BlockEntry>& blocks, uint64_t totalBits, uint32_t flags = 0, const BlockCodings* codings = nullptr);
+void writeContainerHeader(std::vector<unsigned char>& out, uint64_t blockSize, const uint8_t codeLengths[256], const std::vector<BlockEntry>& blocks, uint64_t totalBits, uint32_t flags = 0, const BlockCodings* codings = nullptr);
+
+// parse everything that precedes the payload, returns 0 on success and 1 if malformed
+// (version 1 containers carry no code lengths, and shared model containers only `modelId`; `codeLengths` is then left all 0;
+// `codings` are only filled in for adaptive containers)
+int readContainerHeader(const unsigned char* data, size_t size, ContainerHeader& header, uint8_t codeLengths[256], uint64_t& modelId, std::vector<BlockEntry>& blocks, BlockCodings& codings, size_t& payloadOffset);
@@ -0,0 +1,422 @@
+/* decodetable.cpp */
+
+//
+// Implementation of the multi-level Huffman decode tables
+//
+
+#include <algorithm>
+#include <map>
+
+#include "container.h"
+#include "decodetable.h"
+
+// the low `count` bits of `value`
+static uint64_t lowBits(uint64_t value, int count)
+{
+    return (count >= 64) ? value : value & ((uint64_t(1) << count) - 1);
+}
+
+// record the code of every leaf below `node` (left = 0, right = 1)
+static int collectCodes(const HuffmanTree& tree, uint16_t node, int depth, uint64_t code, uint8_t codeLengths[256], uint64_t codes[256])
+{
+    if (tree.isLeaf(node))
+    {
+        unsigned char c = static_cast<unsigned char>(tree[node].ch);
+        codeLengths[c] = static_cast<uint8_t>(depth);
+        codes[c] = code;
+        return 0;
+    }
+    if (depth >= 64)
+    {
+        return 1;
+    }
+    if (collectCodes(tree, tree[node].left, depth + 1, code << 1, codeLengths, codes) != 0)
+    {
+        return 1;
+    }
+    return collectCodes(tree, tree[node].right, depth + 1, (code << 1) | 1, codeLengths, codes);
+}
+
+DecodeTable::DecodeTable()
+    : maxLength(0) {}
+
+// build from each byte's code length (0 = unused) and code
+int DecodeTable::build(const uint8_t codeLengths[256], const uint64_t codeValues[256])
+{
+    std::vector<int> symbols;
+    maxLength = 0;
+    for (int c = 0; c < 256; c++)
+    {
+        lengths[c] = codeLengths[c];
+        codes[c] = codeValues[c];
+        if (codeLengths[c] != 0)
+        {
+            symbols.push_back(c);
+            maxLength = std::max<int>(maxLength, codeLengths[c]);
+        }
+    }
+    if (maxLength > 64)
+    {
+        return 1;
+    }
+
+    entries.clear();
+    buildTable(ROOT_BITS, symbols, 0);
+    pairRootEntries();
+    return 0;
+}
+
+// build from canonical code lengths (as stored in a container)
+int DecodeTable::buildCanonical(const uint8_t codeLengths[256])
+{
+    uint64_t canonical[256];
+    if (assignCanonicalCodes(codeLengths, canonical) != 0)
+    {
+        return 1;
+    }
+    return build(codeLengths, canonical);
+}
+
+// build from a Huffman tree (as stored in a legacy tree.json)
+int DecodeTable::buildFromTree(const HuffmanTree& tree)
+{
+    uint8_t codeLengths[256] = {};
+    uint64_t codeValues[256] = {};
+    if (tree.empty())
+    {
+        return 1;
+    }
+
+    // a tree with a single leaf still spends one bit per symbol
+    if (tree.isLeaf(tree.root()))
+    {
+        codeLengths[static_cast<unsigned char>(tree[tree.root()].ch)] = 1;
+        return build(codeLengths, codeValues);
+    }
+    if (collectCodes(tree, tree.root(), 0, 0, codeLengths, codeValues) != 0)
+    {
+        return 1;
+    }
+    return build(codeLengths, codeValues);
+}
+
+// append a table of 2^bits entries for `symbols`, whose first `consumed` code bits are already matched
+// returns the table's offset
+uint32_t DecodeTable::buildTable(int bits, const std::vector<int>& symbols, int consumed)
+{
+    uint32_t base = static_cast<uint32_t>(entries.size());
+    entries.resize(entries.size() + (size_t(1) << bits));
+
+    // codes that end within this table fill every index that starts with their remaining bits,
+    // longer codes are grouped by their next `bits` bits for a sub-table
+    std::map<uint32_t, std::vector<int>> longer;
+    for (int c : symbols)
+    {
+        int remaining = lengths[c] - consumed;
+        uint64_t rest = lowBits(codes[c], remaining);
+        if (remaining <= bits)
+        {
+            DecodeEntry leaf = {};
+            leaf.symbols[0] = static_cast<uint8_t>(c);
+            leaf.count = 1;
+            leaf.length = static_cast<uint8_t>(remaining);
+            leaf.firstLength = static_cast<uint8_t>(remaining);
+
+            uint32_t first = base + static_cast<uint32_t>(rest << (bits - remaining));
+            std::fill(entries.begin() + first, entries.begin() + first + (1u << (bits - remaining)), leaf);
+        }
+        else
+        {
+            longer[static_cast<uint32_t>(rest >> (remaining - bits))].push_back(c);
+        }
+    }
+
+    // link each group to a deeper table for the rest of its codes
+    for (const auto& [prefix, group] : longer)
+    {
+        int deepest = 0;
+        for (int c : group)
+        {
+            deepest = std::max(deepest, lengths[c] - consumed - bits);
+        }
+        int subBits = std::min(deepest, SUB_BITS);
+        uint32_t offset = buildTable(subBits, group, consumed + bits);
+
+        DecodeEntry link = {};
+        link.next = offset;
+        link.count = 0;
+        link.length = static_cast<uint8_t>(subBits);
+        entries[base + prefix] = link;
+    }
+    return base;
+}
+
+// let short codes carry a second symbol when the leftover index bits hold a whole code
+void DecodeTable::pairRootEntries()
+{
+    const uint32_t mask = (1u << ROOT_BITS) - 1;
+    for (uint32_t index = 0; index <= mask; index++)
+    {
+        DecodeEntry& entry = entries[index];
+        if (entry.count != 1 || entry.length >= ROOT_BITS)
+        {
+            continue;
+        }
+
+        // the bits after the first code, left-aligned, index the root table again
+        // (only symbols[0] and firstLength are read here, and pairing never changes those)
+        const DecodeEntry& second = entries[(index << entry.firstLength) & mask];
+        int leftover = ROOT_BITS - entry.firstLength;
+        if (second.count != 0 && second.firstLength <= leftover)
+        {
+            entry.symbols[1] = second.symbols[0];
+            entry.count = 2;
+            entry.length = static_cast<uint8_t>(entry.firstLength + second.firstLength);
+        }
+    }
+}
+
+// decode up to `maxSymbols` symbols into `out`, stopping early at the end of the reader's bits
+size_t DecodeTable::decode(BitReader& reader, unsigned char* out, size_t maxSymbols) const
+{
+    return decodeUntil(reader, UINT64_MAX, out, maxSymbols);
+}
+
+// the same, but also stops before the first symbol that starts at or after `endBit`
+size_t DecodeTable::decodeUntil(BitReader& reader, uint64_t endBit, unsigned char* out, size_t maxSymbols) const
+{
+    size_t outCount = 0;
+
+    // fast path: while a whole root lookup (and the longest code) still fits, trust every entry;
+    // a paired second symbol starts within ROOT_BITS, so it starts before `endBit` too
+    uint64_t guard = static_cast<uint64_t>(std::max(maxLength, ROOT_BITS));
+    uint64_t fastEnd = (endBit > guard) ? endBit - guard : 0;
+    while (reader.bitsLeft() > guard && reader.position() < fastEnd && outCount + 2 <= maxSymbols)
+    {
+        // one lookup decodes up to two short codes at once
+        const DecodeEntry* entry = &entries[reader.peek(ROOT_BITS)];
+        if (entry->count != 0)
+        {
+            out[outCount] = entry->symbols[0];
+            out[outCount + 1] = entry->symbols[1];
+            outCount += entry->count;
+            reader.consume(entry->length);
+            continue;
+        }
+
+        // long code: continue in the sub-tables
+        reader.consume(ROOT_BITS);
+        while (true)
+        {
+            int subBits = entry->length;
+            if (subBits == 0)
+            {
+                // bits that match no code
+                return outCount;
+            }
+            entry = &entries[entry->next + reader.peek(subBits)];
+            if (entry->count != 0)
+            {
+                out[outCount++] = entry->symbols[0];
+                reader.consume(entry->firstLength);
+                break;
+            }
+            reader.consume(subBits);
+        }
+    }
+
+    // tail: one symbol at a time, stopping at the 0s used to pad the last byte
+    while (reader.bitsLeft() > 0 && reader.position() < endBit && outCount < maxSymbols)
+    {
+        uint64_t left = reader.bitsLeft();
+        uint64_t start = reader.position();
+        int bits = ROOT_BITS;
+        const DecodeEntry* entry = &entries[reader.peek(ROOT_BITS)];
+        while (entry->count == 0)
+        {
+            if (entry->length == 0)
+            {
+                // bits that match no code
+                return outCount;
+            }
+            reader.consume(bits);
+            bits = entry->length;
+            entry = &entries[entry->next + reader.peek(bits)];
+        }
+        reader.consume(entry->firstLength);
+        if (reader.position() - start > left)
+        {
+            // only padding was left, leave the reader at the end
+            reader.seek(start + left);
+            break;
+        }
+        out[outCount++] = entry->symbols[0];
+    }
+
+    return outCount;
+}
+
+// one symbol through the root table and any sub-tables, -1 for bits that match no code
+inline int DecodeTable::decodeSymbol(BitReader& reader) const
+{
+    int bits = ROOT_BITS;
+    const DecodeEntry* entry = &entries[reader.peek(ROOT_BITS)];
+    while (entry->count == 0)
+    {
+        if (entry->length == 0)
+        {
+            return -1;
+        }
+        reader.consume(bits);
+        bits = entry->length;
+        entry = &entries[entry->next + reader.peek(bits)];
+    }
+    reader.consume(entry->firstLength);
+    return entry->symbols[0];
+}
+
+// decode `count` symbols spread over interleaved streams (symbol i comes from streams[i % INTERLEAVED_STREAMS])
+size_t DecodeTable::decodeInterleaved(BitReader streams[INTERLEAVED_STREAMS], unsigned char* out, size_t count) const
+{
+    const int N = INTERLEAVED_STREAMS;
+    size_t outCount = 0;
+
+    // fast path: one symbol from every stream per round, the lookups do not depend on each other
+    // so the CPU can have all of them in flight at once
+    uint64_t guard = static_cast<uint64_t>(std::max(maxLength, ROOT_BITS));
+    auto allHaveBits = [&]()
+    {
+        for (int s = 0; s < N; s++)
+        {
+            if (streams[s].bitsLeft() <= guard)
+            {
+                return false;
+            }
+        }
+        return true;
+    };
+    while (outCount + N <= count && allHaveBits())
+    {
+        int symbols[N];
+        for (int s = 0; s < N; s++)
+        {
+            symbols[s] = decodeSymbol(streams[s]);
+        }
+        for (int s = 0; s < N; s++)
+        {
+            if (symbols[s] < 0)
+            {
+                return outCount;
+            }
+            out[outCount + s] = static_cast<unsigned char>(symbols[s]);
+        }
+        outCount += N;
+    }
+
+    // tail: finish each stream on its own through the careful single-stream decoder
+    unsigned char scratch[256];
+    for (int s = 0; s < N; s++)
+    {
+        size_t next = outCount + s;
+        while (next < count)
+        {
+            size_t wanted = std::min<size_t>(sizeof(scratch), (count - next + N - 1) / N);
+            size_t decoded = decode(streams[s], scratch, wanted);
+            for (size_t k = 0; k < decoded; k++, next += N)
+            {
+                out[next] = scratch[k];
+            }
+            if (decoded < wanted)
+            {
+                return outCount;
+            }
+        }
+    }
+    return count;
+}
+
+// decode one block written as interleaved streams
+size_t decodeInterleavedBlock(const DecodeTable& table, const unsigned char* payload, size_t payloadBytes, uint64_t blockStart, uint64_t blockEnd, unsigned char* out, size_t length)
+{
+    // the block starts on a whole byte with the sizes of all streams but the last
+    const int N = INTERLEAVED_STREAMS;
+    uint64_t streamSizes[N - 1];
+    uint64_t offset = blockStart / 8 + sizeof(streamSizes);
+    uint64_t end = blockEnd / 8;
+    if (blockStart % 8 != 0 || offset > end)
+    {
+        return 0;
+    }
+    memcpy(streamSizes, payload + blockStart / 8, sizeof(streamSizes));
+
+    // then the streams, each starting on a whole byte
+    std::vector<BitReader> streams;
+    for (int s = 0; s < N; s++)
+    {
+        uint64_t streamBytes = (s + 1 < N) ? streamSizes[s] : end - offset;
+        if (streamBytes > end - offset)
+        {
+            return 0;
+        }
+        streams.emplace_back(payload, payloadBytes, (offset + streamBytes) * 8);
+        streams.back().seek(offset * 8);
+        offset += streamBytes;
+    }
+    return table.decodeInterleaved(streams.data(), out, length);
+}
+
+// decode block `i` of a container into `out`
+size_t decodeBlock(const DecodeTable& table, const unsigned char* payload, size_t payloadBytes, const ContainerHeader& header, const std::vector<BlockEntry>& blocks, size_t i, unsigned char* out)
+{
+    uint64_t blockEnd = (i + 1 < blocks.size()) ? blocks[i + 1].bitOffset : header.totalBits;
+    if (header.flags & FLAG_INTERLEAVED)
+    {
+        return decodeInterleavedBlock(table, payload, payloadBytes, blocks[i].bitOffset, blockEnd, out, blocks[i].decodedLength);
+    }
+    BitReader reader(payload, payloadBytes, blockEnd);
+    reader.seek(blocks[i].bitOffset);
+    return table.decode(reader, out, blocks[i].decodedLength);
+}
+
+// build from a container's codings
+int BlockTables::build(const BlockCodings& codings)
+{
+    tables.resize(codings.tables.size());
+    for (size_t t = 0; t < tables.size(); t++)
+    {
+        if (tables[t].buildCanonical(codings.tables[t].data()) != 0)
+        {
+            return 1;
+        }
+    }
+
+    // a block without a table of its own uses the last one before it
+    blockTable.resize(codings.kinds.size());
+    int current = NO_TABLE;
+    for (size_t i = 0; i < codings.kinds.size(); i++)
+    {
+        current += (codings.kinds[i] == BLOCK_NEW_TABLE);
+        blockTable[i] = (codings.kinds[i] == BLOCK_STORED) ? NO_TABLE : current;
+    }
+    return 0;
+}
+
+// decode block `i` of an adaptive container into `out`
+size_t decodeAdaptiveBlock(const BlockTables& tables, const unsigned char* payload, size_t payloadBytes, const ContainerHeader& header, const std::vector<BlockEntry>& blocks, size_t i, unsigned char* out)
+{
+    int t = tables.blockTable[i];
+    if (t != BlockTables::NO_TABLE)
+    {
+        return decodeBlock(tables.tables[t], payload, payloadBytes, header, blocks, i, out);
+    }
+
+    // a stored block is whole bytes, just copy them
+    uint64_t blockEnd = (i + 1 < blocks.size()) ? blocks[i + 1].bitOffset : header.totalBits;
+    uint64_t blockBytes = (blockEnd - blocks[i].bitOffset) / 8;
+    if (blocks[i].bitOffset % 8 != 0 || blockBytes < blocks[i].decodedLength)
+    {
+        return 0;
+    }
+    memcpy(out, payload + blocks[i].bitOffset / 8, blocks[i].decodedLength);
+    return blocks[i].decodedLength;
+}
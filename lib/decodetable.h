@@ -0,0 +1,104 @@
+/* decodetable.h */
+
+//
+// Lookup tables for decoding several Huffman bits at a time
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "bitreader.h"
+#include "container.h"
+#include "huffman.h"
+
+/// <summary>
+/// A DecodeEntry tells the decoder what the next few bits of input mean.
+/// Entries with count 1 or 2 hold that many decoded symbols and the number
+/// of bits they used up. Entries with count 0 are links: the code is longer
+/// than this table's index, so the decoder drops the bits it already looked
+/// at and continues in the sub-table at `next`, which is indexed by the
+/// following `length` bits. An entry with count 0 and length 0 matches no
+/// code at all and means the input is corrupt.
+/// </summary>
+struct DecodeEntry {
+    uint32_t next;       // offset of the sub-table (links only)
+    uint8_t symbols[2];  // decoded symbols, in output order
+    uint8_t count;       // number of symbols, or 0 for a link
+    uint8_t length;      // bits used by all symbols, or the sub-table's index width for links
+    uint8_t firstLength; // bits used by the first symbol alone
+};
+
+/// <summary>
+/// A DecodeTable is a multi-level lookup table built once from a prefix code.
+/// The root table is indexed by the next ROOT_BITS bits of input; a single
+/// lookup yields one or two whole symbols for short codes. Codes longer than
+/// ROOT_BITS fall back to second-level (and deeper) tables of up to SUB_BITS bits.
+/// </summary>
+class DecodeTable {
+public:
+    static constexpr int ROOT_BITS = 11;
+    static constexpr int SUB_BITS = 8;
+
+    DecodeTable();
+
+    // build from each byte's code length (0 = unused) and code, returns 0 on success and 1 if the codes are too long
+    int build(const uint8_t codeLengths[256], const uint64_t codes[256]);
+
+    // build from canonical code lengths (as stored in a container), returns 0 on success and 1 if they are invalid
+    int buildCanonical(const uint8_t codeLengths[256]);
+
+    // build from a Huffman tree (as stored in a legacy tree.json), returns 0 on success and 1 if it is too deep
+    int buildFromTree(const HuffmanTree& tree);
+
+    // length of the longest code
+    int maxCodeLength() const { return maxLength; }
+
+    // decode up to `maxSymbols` symbols into `out`, stopping early at the end of the reader's bits
+    // (or at bits that match no code) and returns the number of symbols decoded
+    size_t decode(BitReader& reader, unsigned char* out, size_t maxSymbols) const;
+
+    // the same, but also stops before the first symbol that starts at or after `endBit` (the last symbol
+    // decoded may run past it), so a stream can be decoded a stretch of bits at a time
+    size_t decodeUntil(BitReader& reader, uint64_t endBit, unsigned char* out, size_t maxSymbols) const;
+
+    // decode `count` symbols spread over interleaved streams (symbol i comes from streams[i % INTERLEAVED_STREAMS])
+    // and returns the number of symbols decoded, which is less than `count` if a stream is corrupt
+    size_t decodeInterleaved(BitReader streams[INTERLEAVED_STREAMS], unsigned char* out, size_t count) const;
+
+private:
+    uint32_t buildTable(int bits, const std::vector<int>& symbols, int consumed);
+    void pairRootEntries();
+    int decodeSymbol(BitReader& reader) const;
+
+    std::vector<DecodeEntry> entries;
+    uint8_t lengths[256];
+    uint64_t codes[256];
+    int maxLength;
+};
+
+// decode one block written as interleaved streams (see container.h) covering payload bits [blockStart, blockEnd)
+// into `out`, returns the number of symbols decoded (less than `length` if the block is corrupt)
+size_t decodeInterleavedBlock(const DecodeTable& table, const unsigned char* payload, size_t payloadBytes, uint64_t blockStart, uint64_t blockEnd, unsigned char* out, size_t length);
+
+// decode block `i` of a container, plain or interleaved, into `out` and returns the number of symbols decoded
+size_t decodeBlock(const DecodeTable& table, const unsigned char* payload, size_t payloadBytes, const ContainerHeader& header, const std::vector<BlockEntry>& blocks, size_t i, unsigned char* out);
+
+/// <summary>
+/// BlockTables are the decode tables of an adaptive container (see
+/// BlockCodings), each built once, and which one every block is decoded with.
+/// </summary>
+struct BlockTables {
+    static constexpr int NO_TABLE = -1;
+
+    std::vector<DecodeTable> tables;
+    std::vector<int> blockTable; // index into `tables` for each block, NO_TABLE for a stored block
+
+    // build from a container's codings, returns 0 on success and 1 if a table is invalid
+    int build(const BlockCodings& codings);
+};
+
+// decode block `i` of an adaptive container with the table it picked, or copy it out if it is stored
+size_t decodeAdaptiveBlock(const BlockTables& tables, const unsigned char* payload, size_t payloadBytes, const ContainerHeader& header, const std::vector<BlockEntry>& blocks, size_t i, unsigned char* out);
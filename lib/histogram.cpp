@@ -0,0 +1,54 @@
+/* histogram.cpp */
+
+//
+// Implementation of the byte frequency counting kernel
+//
+
+#include <cstring>
+
+#include "histogram.h"
+
+// Runs of the same byte make consecutive increments hit the same counter, and each
+// one then waits for the previous store to land. Spreading neighbouring bytes over
+// several sub-histograms breaks that chain; they are summed at the end.
+static const int LANES = 4;
+
+// count the 8 bytes of a word into the lanes
+static inline void countWord(uint64_t word, uint64_t lanes[LANES][256])
+{
+    lanes[0][word & 0xff]++;
+    lanes[1][(word >> 8) & 0xff]++;
+    lanes[2][(word >> 16) & 0xff]++;
+    lanes[3][(word >> 24) & 0xff]++;
+    lanes[0][(word >> 32) & 0xff]++;
+    lanes[1][(word >> 40) & 0xff]++;
+    lanes[2][(word >> 48) & 0xff]++;
+    lanes[3][word >> 56]++;
+}
+
+// add the byte counts of data[0, size) to `counts`
+void countBytes(const unsigned char* data, size_t size, uint64_t counts[256])
+{
+    alignas(64) uint64_t lanes[LANES][256];
+    std::memset(lanes, 0, sizeof(lanes));
+
+    // 8 bytes per load, spread over the lanes
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, data + i, sizeof(word));
+        countWord(word, lanes);
+    }
+
+    // leftover bytes
+    for (; i < size; i++)
+    {
+        lanes[0][data[i]]++;
+    }
+
+    for (int c = 0; c < 256; c++)
+    {
+        counts[c] += lanes[0][c] + lanes[1][c] + lanes[2][c] + lanes[3][c];
+    }
+}
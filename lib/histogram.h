@@ -0,0 +1,22 @@
+/* histogram.h */
+
+//
+// Byte frequency counting over flat 256-entry tables
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/// <summary>
+/// A Histogram holds one 64-bit count per byte value. It is aligned to (and
+/// a multiple of) a cache line, so a vector of them gives each thread its
+/// own lines and threads counting side by side never false-share.
+/// </summary>
+struct alignas(64) Histogram {
+    uint64_t counts[256];
+};
+
+// add the byte counts of data[0, size) to `counts`
+void countBytes(const unsigned char* data, size_t size, uint64_t counts[256]);
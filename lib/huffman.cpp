@@ -0,0 +1,388 @@
+/* huffman.cpp */
+
+//
+// Implementation of functions to create, read and manipulate a Huffman tree
+//
+
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "container.h"
+#include "huffman.h"
+
+using namespace std;
+
+HuffmanTree::HuffmanTree()
+    : count(0) {}
+
+// add a leaf, returns its index (NO_NODE if the tree is full)
+uint16_t HuffmanTree::addLeaf(char ch, uint64_t freq)
+{
+    if (count == MAX_NODES) 
+    {
+        return NO_NODE;
+    }
+    nodes[count] = {freq, NO_NODE, NO_NODE, ch};
+    return count++;
+}
+
+// add an internal node over two existing nodes, returns its index (NO_NODE if the tree is full)
+uint16_t HuffmanTree::addInternal(uint16_t left, uint16_t right)
+{
+    if (count == MAX_NODES) 
+    {
+        return NO_NODE;
+    }
+    nodes[count] = {nodes[left].freq + nodes[right].freq, left, right, '\0'};
+    return count++;
+}
+
+// build a Huffman tree with two queues instead of a priority queue
+// The leaves are sorted once. Every new internal node weighs at least as much as the one before it,
+// so the internal nodes form a second queue that is already sorted, and the two smallest nodes are
+// always at the front of one queue or the other
+void buildHuffmanTree(const uint64_t freqs[256], HuffmanTree& tree) 
+{
+    tree.clear();
+
+    // leaves for each character that appears, least frequent first (ties in character order, so they always break the same way)
+    int order[256];
+    int leafCount = 0;
+    for (int c = 0; c < 256; c++) 
+    {
+        if (freqs[c] > 0)
+        {
+            order[leafCount++] = c;
+        }
+    }
+    std::stable_sort(order, order + leafCount, [&](int a, int b) { return freqs[a] < freqs[b]; });
+    for (int i = 0; i < leafCount; i++) 
+    {
+        tree.addLeaf(static_cast<char>(order[i]), freqs[order[i]]);
+    }
+
+    // leaves sit at [0, leafCount) and internal nodes are appended after them in the order they are made
+    uint16_t nextLeaf = 0;
+    uint16_t nextInternal = static_cast<uint16_t>(leafCount);
+    auto takeSmallest = [&]() -> uint16_t 
+    {
+        // leaves go first on ties
+        bool leafLeft = nextLeaf < leafCount;
+        bool internalLeft = nextInternal < tree.size();
+        if (leafLeft && (!internalLeft || tree[nextLeaf].freq <= tree[nextInternal].freq)) 
+        {
+            return nextLeaf++;
+        }
+        return nextInternal++;
+    };
+
+    // build tree by repeatedly combining the two smallest nodes
+    for (int merges = 1; merges < leafCount; merges++) 
+    {
+        uint16_t left = takeSmallest();
+        uint16_t right = takeSmallest();
+        tree.addInternal(left, right);
+    }
+}
+
+// record the depth of every leaf below `node`
+static void collectDepths(const HuffmanTree& tree, uint16_t node, int depth, uint8_t codeLengths[256])
+{
+    // at a leaf, its depth is its code length
+    if (tree.isLeaf(node)) 
+    {
+        codeLengths[static_cast<unsigned char>(tree[node].ch)] = static_cast<uint8_t>(depth);
+        return;
+    }
+
+    collectDepths(tree, tree[node].left, depth + 1, codeLengths);
+    collectDepths(tree, tree[node].right, depth + 1, codeLengths);
+}
+
+// find the code length of each character
+void computeCodeLengths(const HuffmanTree& tree, uint8_t codeLengths[256]) 
+{
+    for (int c = 0; c < 256; c++) 
+    {
+        codeLengths[c] = 0;
+    }
+    if (tree.empty()) 
+    {
+        return;
+    }
+
+    // a lone leaf would get an empty code, so give it one bit
+    if (tree.isLeaf(tree.root())) 
+    {
+        codeLengths[static_cast<unsigned char>(tree[tree.root()].ch)] = 1;
+        return;
+    }
+    collectDepths(tree, tree.root(), 0, codeLengths);
+}
+
+// one item in a package-merge list: a single character or a package of two items from the list before it
+struct PackageItem {
+    uint64_t weight;
+    int symbol; // index into the sorted characters, or -1 for a package
+};
+
+// limit code lengths with package-merge
+// Every character starts as a coin of its frequency in each of the `maxLength` denominations. Going from the
+// smallest denomination up, neighbouring pairs of the previous list are packaged and merged with the coins
+// again. The cheapest 2n - 2 items of the last list are picked, and each character's code length is how many
+// lists its coin gets picked from. Since packages are always made from the front of the previous list, picking
+// the first p packages of one list means picking the first 2p items of the list before it.
+int limitCodeLengths(const uint64_t freqs[256], int maxLength, uint8_t codeLengths[256])
+{
+    // characters that appear, least frequent first (ties in character order, like the tree)
+    std::vector<int> sorted;
+    for (int c = 0; c < 256; c++) 
+    {
+        codeLengths[c] = 0;
+        if (freqs[c] > 0) 
+        {
+            sorted.push_back(c);
+        }
+    }
+    std::stable_sort(sorted.begin(), sorted.end(), [&](int a, int b) { return freqs[a] < freqs[b]; });
+
+    size_t n = sorted.size();
+    if (n == 0) 
+    {
+        return 0;
+    }
+    if (n == 1) 
+    {
+        codeLengths[sorted[0]] = 1;
+        return 0;
+    }
+    if (maxLength < 1 || (maxLength < 64 && (uint64_t(1) << maxLength) < n)) 
+    {
+        return 1;
+    }
+
+    // lists[0] holds the coins alone, every later list merges them with packages of the list before
+    std::vector<std::vector<PackageItem>> lists(maxLength);
+    for (size_t i = 0; i < n; i++) 
+    {
+        lists[0].push_back({freqs[sorted[i]], static_cast<int>(i)});
+    }
+    for (int level = 1; level < maxLength; level++) 
+    {
+        const std::vector<PackageItem>& previous = lists[level - 1];
+        std::vector<PackageItem>& list = lists[level];
+        size_t packages = previous.size() / 2;
+        size_t coin = 0;
+        size_t package = 0;
+        while (coin < n || package < packages) 
+        {
+            uint64_t packageWeight = (package < packages) ? previous[2 * package].weight + previous[2 * package + 1].weight : 0;
+            // coins go first on ties
+            if (package == packages || (coin < n && freqs[sorted[coin]] <= packageWeight)) 
+            {
+                list.push_back({freqs[sorted[coin]], static_cast<int>(coin)});
+                coin++;
+            }
+            else 
+            {
+                list.push_back({packageWeight, -1});
+                package++;
+            }
+        }
+    }
+
+    // pick the cheapest 2n - 2 items and follow the packages back down
+    size_t picked = 2 * n - 2;
+    for (int level = maxLength - 1; level >= 0 && picked > 0; level--) 
+    {
+        size_t packages = 0;
+        for (size_t i = 0; i < picked; i++) 
+        {
+            const PackageItem& item = lists[level][i];
+            if (item.symbol >= 0) 
+            {
+                codeLengths[sorted[item.symbol]]++;
+            }
+            else 
+            {
+                packages++;
+            }
+        }
+        picked = 2 * packages;
+    }
+    return 0;
+}
+
+// total number of bits the content takes with the given code lengths
+uint64_t countEncodedBits(const uint64_t freqs[256], const uint8_t codeLengths[256])
+{
+    uint64_t bits = 0;
+    for (int c = 0; c < 256; c++) 
+    {
+        bits += freqs[c] * codeLengths[c];
+    }
+    return bits;
+}
+
+// generate canonical Huffman codes for each character
+// Only the lengths come from the tree: codes of the same length are handed out in character order,
+// so the decoder can rebuild them from the lengths alone
+int generateCodes(const uint8_t codeLengths[256], CodeTable& codes) 
+{
+    uint64_t canonical[256];
+    if (assignCanonicalCodes(codeLengths, canonical) != 0) 
+    {
+        return 1;
+    }
+
+    for (int c = 0; c < 256; c++) 
+    {
+        codes.codes[c].bits = (codeLengths[c] == 0) ? 0 : canonical[c];
+        codes.codes[c].length = codeLengths[c];
+    }
+    return 0;
+}
+
+/// Helpers for reading JSON formatted Huffman tree
+/// A pointer walks the whole file in one pass: keys are compared in place rather than copied into
+/// strings, and nesting is tracked on a fixed stack rather than by recursion
+// Skips whitespace characters
+static void skipWhitespace(const char*& p, const char* end) 
+{
+    while (p < end && isspace(static_cast<unsigned char>(*p))) 
+    {
+        p++;
+    }
+}
+// Expect one character (after any whitespace)
+static void expectChar(const char*& p, const char* end, char c, const char* error) 
+{
+    skipWhitespace(p, end);
+    if (p == end || *p != c) 
+    {
+        throw runtime_error(error);
+    }
+    p++;
+}
+// Parse string (key) in place, returns whether it is `key`
+// Keys are only ever ch, freq, left and right, so an escape sequence cannot be one of them
+static bool parseKey(const char*& p, const char* end, const char* key) 
+{
+    expectChar(p, end, '"', "Expected quotation mark!");
+    const char* begin = p;
+    while (p < end && *p != '"') 
+    {
+        if (*p == '\\') 
+        {
+            p++; // skip the escaped character
+        }
+        p++;
+    }
+    if (p >= end) 
+    {
+        throw runtime_error("Something else went wrong!");
+    }
+    size_t length = static_cast<size_t>(p - begin);
+    p++;
+    return length == char_traits<char>::length(key) && equal(begin, begin + length, key);
+}
+// Parse key and the ':' after it
+static void expectKey(const char*& p, const char* end, const char* key, const char* error) 
+{
+    if (!parseKey(p, end, key)) 
+    {
+        throw runtime_error(error);
+    }
+    expectChar(p, end, ':', "Key/value pair must be separated by ':'");
+}
+// Parse integer (value)
+// Frequencies can pass 2^31 on large inputs, so values are read as 64-bit
+static uint64_t parseInt(const char*& p, const char* end) 
+{
+    skipWhitespace(p, end);
+    if (p == end || !isdigit(static_cast<unsigned char>(*p))) 
+    {
+        throw runtime_error("Expected digit!");
+    }
+
+    uint64_t value = 0;
+    while (p < end && isdigit(static_cast<unsigned char>(*p))) 
+    {
+        // if we add a digit, we need to multiply the current value by 10 then add the new digit
+        value = value * 10 + static_cast<uint64_t>(*p++ - '0');
+    }
+    return value;
+}
+// Fully read tree
+// Every internal node waiting for its children has an entry on the stack: NO_NODE while its left
+// subtree is being read, the left child's index while its right one is. A tree deeper than it has
+// room for would need more nodes than a HuffmanTree holds anyway.
+void readTreeJson(const char* data, size_t size, HuffmanTree& tree) 
+{
+    const char* p = data;
+    const char* end = data + size;
+    uint16_t pending[HuffmanTree::MAX_NODES];
+    int depth = 0;
+    tree.clear();
+    while (true) 
+    {
+        // first character is '{', then depending on the first key, we have leaf or internal node
+        expectChar(p, end, '{', "Need '{' at beginning!");
+        const char* key = p;
+        if (parseKey(p, end, "freq")) 
+        {
+            // get frequency (not kept, it is the sum of the children's), then go down into the left subtree
+            expectChar(p, end, ':', "Key/value pair must be separated by ':'");
+            parseInt(p, end);
+            expectChar(p, end, ',', "Frequency/left/right triple must be separated by ','");
+            expectKey(p, end, "left", "Key should be left!");
+            if (depth == HuffmanTree::MAX_NODES) 
+            {
+                throw runtime_error("Tree is too deep!");
+            }
+            pending[depth++] = HuffmanTree::NO_NODE;
+            continue;
+        } // internal node
+        p = key;
+        expectKey(p, end, "ch", "Something went wrong!");
+
+        // get character (written as integer), then frequency
+        uint64_t chInt = parseInt(p, end);
+        expectChar(p, end, ',', "Character/frequency pair must be separated by ','");
+        expectKey(p, end, "freq", "Second key should be freq!");
+        uint64_t freqInt = parseInt(p, end);
+        expectChar(p, end, '}', "Need '}' at end of leaf!");
+
+        // create leaf node
+        uint16_t node = tree.addLeaf(static_cast<char>(chInt), freqInt);
+        if (node == HuffmanTree::NO_NODE) 
+        {
+            throw runtime_error("Too many nodes!");
+        } // leaf
+
+        // climb back up: finish every node whose right subtree this completes, until one still needs its right
+        while (depth > 0 && pending[depth - 1] != HuffmanTree::NO_NODE) 
+        {
+            expectChar(p, end, '}', "Need '}' at end of node!");
+
+            // create internal node (after its children, so the root ends up last)
+            node = tree.addInternal(pending[--depth], node);
+            if (node == HuffmanTree::NO_NODE) 
+            {
+                throw runtime_error("Too many nodes!");
+            }
+        }
+        if (depth == 0) 
+        {
+            return;
+        }
+
+        // the node was a left subtree, so its parent's right one comes next
+        pending[depth - 1] = node;
+        expectChar(p, end, ',', "Frequency/left/right triple must be separated by ','");
+        expectKey(p, end, "right", "Key should be right!");
+    }
+}
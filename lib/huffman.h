@@ -0,0 +1,96 @@
+/* huffman.h */
+
+//
+// Functions to create, read and manipulate a Huffman tree
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/// <summary>
+/// A HuffmanNode represents a node in the Huffman tree.
+/// It can be a leaf node containing a character and its frequency,
+/// or an internal node that combines two child nodes.
+/// Children are indices into the same HuffmanTree; a leaf has none (NO_NODE).
+/// </summary>
+struct HuffmanNode {
+    uint64_t freq;
+    uint16_t left;
+    uint16_t right;
+    char ch;
+};
+
+/// <summary>
+/// A HuffmanTree keeps every node of a tree in one flat array inside the
+/// object, so building a tree allocates nothing and there is nothing to free.
+/// 256 leaves need at most 255 internal nodes, hence 511 slots. Nodes are
+/// only ever added after their children, so the last node is the root.
+/// </summary>
+class HuffmanTree {
+public:
+    static const int MAX_NODES = 511;
+    static const uint16_t NO_NODE = 0xFFFF;
+
+    HuffmanTree();
+
+    // add a leaf, returns its index (NO_NODE if the tree is full)
+    uint16_t addLeaf(char ch, uint64_t freq);
+
+    // add an internal node over two existing nodes, returns its index (NO_NODE if the tree is full)
+    uint16_t addInternal(uint16_t left, uint16_t right);
+
+    // remove every node
+    void clear() { count = 0; }
+
+    bool empty() const { return count == 0; }
+    uint16_t size() const { return count; }
+    uint16_t root() const { return static_cast<uint16_t>(count - 1); }
+    bool isLeaf(uint16_t index) const { return nodes[index].left == NO_NODE; }
+    const HuffmanNode& operator[](uint16_t index) const { return nodes[index]; }
+
+private:
+    HuffmanNode nodes[MAX_NODES];
+    uint16_t count;
+};
+
+// Build a Huffman tree from a table of 256 byte frequencies (left empty if every count is 0)
+void buildHuffmanTree(const uint64_t freqs[256], HuffmanTree& tree);
+
+// Find the code length of each character (its depth in the tree, 0 if it does not appear)
+// A tree with a single leaf still gets a 1-bit code
+void computeCodeLengths(const HuffmanTree& tree, uint8_t codeLengths[256]);
+
+// Limit every code to at most `maxLength` bits with the package-merge algorithm, giving the
+// cheapest code lengths under that limit (as cheap as Huffman's when the limit is not hit)
+// returns 0 on success, 1 if that many bits cannot give every character that appears a code
+int limitCodeLengths(const uint64_t freqs[256], int maxLength, uint8_t codeLengths[256]);
+
+// Total number of bits the content takes with the given code lengths
+uint64_t countEncodedBits(const uint64_t freqs[256], const uint8_t codeLengths[256]);
+
+/// <summary>
+/// A HuffmanCode is one character's code as an integer, right-aligned and
+/// written most significant bit first, with its length in bits (0 if the
+/// character does not appear). A CodeTable has one per byte value, so the
+/// encode loops find a code with a plain array index.
+/// </summary>
+struct HuffmanCode {
+    uint64_t bits;
+    uint32_t length;
+};
+
+struct CodeTable {
+    HuffmanCode codes[256];
+
+    const HuffmanCode& operator[](unsigned char c) const { return codes[c]; }
+};
+
+// Build the table of canonical Huffman codes, given each character's code length
+// returns 0 on success, 1 if the lengths cannot form a prefix code
+int generateCodes(const uint8_t codeLengths[256], CodeTable& codes);
+
+// Helper function to read a Huffman tree from a JSON formatted buffer (such as a whole tree.json mapped into memory)
+// Same format at written by writeTreeJson in encoding portions of code (throws if it is malformed)
+void readTreeJson(const char* data, size_t size, HuffmanTree& tree);
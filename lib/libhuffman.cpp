@@ -0,0 +1,252 @@
+/* libhuffman.cpp */
+
+//
+// Implementation of the buffer-to-buffer encoder and decoder
+//
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <omp.h>
+
+#include "histogram.h"
+#include "libhuffman.h"
+
+// Huffman code lengths, capped at `maxCodeLength` (0 for MAX_CODE_LENGTH), and their canonical codes
+// returns 0 on success, 1 if that many bits cannot give every byte that appears a code
+static int buildCodes(const uint64_t freqs[256], int maxCodeLength, HuffmanTree& tree, uint8_t codeLengths[256], CodeTable& codes)
+{
+    buildHuffmanTree(freqs, tree);
+    computeCodeLengths(tree, codeLengths);
+    if (tree.empty())
+    {
+        return 0;
+    }
+    int limit = (maxCodeLength > 0) ? maxCodeLength : MAX_CODE_LENGTH;
+    if (*std::max_element(codeLengths, codeLengths + 256) > limit && limitCodeLengths(freqs, limit, codeLengths) != 0)
+    {
+        return 1;
+    }
+    return generateCodes(codeLengths, codes);
+}
+
+Encoder::Encoder(const EncodeOptions& options)
+    : options(options), codeLengths()
+{
+    // a shared model's codes are the same for every input (readModel and trainModel have checked that they form a prefix code)
+    if (options.model)
+    {
+        std::copy(options.model->codeLengths, options.model->codeLengths + 256, codeLengths);
+        generateCodes(codeLengths, codes);
+    }
+}
+
+// encode `input` into `output`
+int Encoder::encode(std::span<const uint8_t> input, std::vector<uint8_t>& output)
+{
+    const unsigned char* data = input.data();
+    uint64_t size = input.size();
+    bool adaptive = options.adaptive && !options.model;
+    bool stored = false;
+
+    // a block size of 0 is one block holding everything (none for an empty input)
+    uint64_t blockSize = (options.blockSize > 0) ? options.blockSize : size;
+    size_t blockCount = (size == 0) ? 0 : static_cast<size_t>((size + blockSize - 1) / blockSize);
+    if (blockWriters.size() < blockCount)
+    {
+        blockWriters.resize(blockCount);
+    }
+
+    if (adaptive && options.blockSize > 0 && options.blockSize < MIN_ADAPTIVE_BLOCK_SIZE)
+    {
+        return 1;
+    }
+    if (adaptive)
+    {
+        // count every block on its own, then choose how to code each (the header's own code lengths stay empty)
+        blockCounts.resize(blockCount);
+        #pragma omp parallel for schedule(dynamic) num_threads(options.numThreads) if(blockCount > 1)
+        for (size_t b = 0; b < blockCount; b++) {
+            uint64_t begin = b * blockSize;
+            uint64_t end = std::min(size, begin + blockSize);
+            std::fill(std::begin(blockCounts[b].counts), std::end(blockCounts[b].counts), 0);
+            countBytes(data + begin, static_cast<size_t>(end - begin), blockCounts[b].counts);
+        }
+        if (planBlocks(blockCounts.data(), blockCount, options.maxCodeLength, options.interleaved, options.minSaving, plan) != 0)
+        {
+            return 1;
+        }
+    }
+    else if (!options.model)
+    {
+        uint64_t freqs[256] = {};
+        countBytes(data, size, freqs);
+        if (buildCodes(freqs, options.maxCodeLength, tree, codeLengths, codes) != 0)
+        {
+            return 1;
+        }
+
+        // input that coding would barely shrink is stored as it is, as an adaptive container with nothing but stored blocks
+        stored = storeInstead(singleTableBits(freqs, codeLengths), size, options.minSaving);
+        if (stored)
+        {
+            planStored(blockCount, plan);
+        }
+    }
+    bool planned = adaptive || stored;
+
+    // blocks do not depend on each other, so threads just grab the next one
+    #pragma omp parallel num_threads(options.numThreads) if(blockCount > 1)
+    {
+        PlanCodes planCodes;
+        #pragma omp for schedule(dynamic)
+        for (size_t b = 0; b < blockCount; b++) {
+            uint64_t begin = b * blockSize;
+            uint64_t end = std::min(size, begin + blockSize);
+            blockWriters[b].clear();
+            if (planned) {
+                encodePlannedBlock(plan, b, data + begin, static_cast<size_t>(end - begin), options.interleaved, planCodes, blockWriters[b]);
+            }
+            else {
+                encodeBlock(data + begin, static_cast<size_t>(end - begin), codes, options.interleaved, blockWriters[b]);
+            }
+        }
+    }
+
+    // against a model, whether coding pays is only known once it is done; if it does not, the input is stored instead
+    if (options.model)
+    {
+        uint64_t codedBits = 0;
+        for (size_t b = 0; b < blockCount; b++)
+        {
+            codedBits += blockWriters[b].finish().size() * 8;
+        }
+        stored = storeInstead(codedBits, size, options.minSaving);
+        if (stored)
+        {
+            planStored(blockCount, plan);
+            planned = true;
+        }
+    }
+
+    // block index: each block starts on a whole byte right after the previous one (a stored block is its input)
+    blocks.resize(blockCount);
+    uint64_t bitOffset = 0;
+    for (size_t b = 0; b < blockCount; b++)
+    {
+        blocks[b].bitOffset = bitOffset;
+        blocks[b].decodedLength = std::min(blockSize, size - b * blockSize);
+        bitOffset += (planned && plan.stored(b)) ? blocks[b].decodedLength * 8 : blockWriters[b].finish().size() * 8;
+    }
+
+    output.clear();
+    output.reserve(sizeof(ContainerHeader) + 2 + 256 + blockCount * sizeof(BlockEntry) + bitOffset / 8);
+    const uint8_t noCodeLengths[256] = {}; // planned containers carry their tables in the codings
+    uint32_t flags = (options.interleaved ? FLAG_INTERLEAVED : 0) | ((options.model && !stored) ? FLAG_SHARED_MODEL : 0) | (planned ? FLAG_ADAPTIVE : 0);
+    writeContainerHeader(output, blockSize, planned ? noCodeLengths : codeLengths, blocks, bitOffset, flags, &plan.codings);
+    for (size_t b = 0; b < blockCount; b++)
+    {
+        if (planned && plan.stored(b))
+        {
+            output.insert(output.end(), data + b * blockSize, data + b * blockSize + blocks[b].decodedLength);
+            continue;
+        }
+        const std::vector<unsigned char>& bytes = blockWriters[b].finish();
+        output.insert(output.end(), bytes.begin(), bytes.end());
+    }
+    return 0;
+}
+
+Decoder::Decoder(int numThreads, const Model* model)
+    : numThreads(std::max(1, numThreads)), model(model)
+{
+    if (model)
+    {
+        modelTable.buildCanonical(model->codeLengths);
+    }
+}
+
+// decode the container in `input` into `output`
+int Decoder::decode(std::span<const uint8_t> input, std::vector<uint8_t>& output)
+{
+    ContainerHeader header = {};
+    uint8_t codeLengths[256] = {};
+    uint64_t modelId = 0;
+    size_t payloadOffset = 0;
+    if (readContainerHeader(input.data(), input.size(), header, codeLengths, modelId, blocks, codings, payloadOffset) != 0 || header.version < 2)
+    {
+        return 1;
+    }
+
+    // the model's table is already built, adaptive containers bring a table per block, anything else its own code lengths
+    bool shared = (header.flags & FLAG_SHARED_MODEL);
+    bool adaptive = (header.flags & FLAG_ADAPTIVE);
+    if (shared && (!model || model->id != modelId))
+    {
+        return 1;
+    }
+    if (adaptive && blockTables.build(codings) != 0)
+    {
+        return 1;
+    }
+    if (!shared && !adaptive && table.buildCanonical(codeLengths) != 0)
+    {
+        return 1;
+    }
+    const DecodeTable& codeTable = shared ? modelTable : table;
+    const unsigned char* payload = input.data() + payloadOffset;
+    size_t payloadBytes = input.size() - payloadOffset;
+
+    // readContainerHeader has already checked that no block decodes to more bytes than it has bits
+    std::vector<uint64_t> outOffsets(blocks.size() + 1, 0);
+    for (size_t i = 0; i < blocks.size(); i++)
+    {
+        outOffsets[i + 1] = outOffsets[i] + blocks[i].decodedLength;
+    }
+    output.resize(static_cast<size_t>(outOffsets.back()));
+
+    // one plain block: split it up within
+    if (blocks.size() == 1 && blocks[0].bitOffset == 0 && !(header.flags & (FLAG_INTERLEAVED | FLAG_ADAPTIVE)) && numThreads > 1)
+    {
+        size_t decoded = decodeSelfSync(codeTable, payload, payloadBytes, header.totalBits, numThreads, output.data(), output.size(), chunks);
+        return (decoded == output.size()) ? 0 : 1;
+    }
+
+    // blocks are independent, so threads just grab the next one
+    bool corrupt = false;
+    #pragma omp parallel for schedule(dynamic) num_threads(numThreads) if(blocks.size() > 1)
+    for (size_t i = 0; i < blocks.size(); i++) {
+        size_t decoded = adaptive
+            ? decodeAdaptiveBlock(blockTables, payload, payloadBytes, header, blocks, i, output.data() + outOffsets[i])
+            : decodeBlock(codeTable, payload, payloadBytes, header, blocks, i, output.data() + outOffsets[i]);
+        if (decoded != blocks[i].decodedLength) {
+            #pragma omp atomic write
+            corrupt = true;
+        }
+    }
+    return corrupt ? 1 : 0;
+}
+
+// one-off encode, throws where Encoder::encode returns 1
+std::vector<uint8_t> encode(std::span<const uint8_t> input, const EncodeOptions& options)
+{
+    Encoder encoder(options);
+    std::vector<uint8_t> output;
+    if (encoder.encode(input, output) != 0)
+    {
+        throw std::runtime_error("Codes cannot fit in the maximum code length!");
+    }
+    return output;
+}
+
+// one-off decode, throws where Decoder::decode returns 1
+std::vector<uint8_t> decode(std::span<const uint8_t> encoded, int numThreads, const Model* model)
+{
+    Decoder decoder(numThreads, model);
+    std::vector<uint8_t> output;
+    if (decoder.decode(encoded, output) != 0)
+    {
+        throw std::runtime_error("Not a readable container, or corrupt!");
+    }
+    return output;
+}
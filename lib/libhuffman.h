@@ -0,0 +1,97 @@
+/* libhuffman.h */
+
+//
+// Buffer-to-buffer Huffman encoding and decoding, for programs that compress in memory
+//
+
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "adaptive.h"
+#include "bitwriter.h"
+#include "container.h"
+#include "decodetable.h"
+#include "huffman.h"
+#include "model.h"
+#include "selfsync.h"
+
+/// <summary>
+/// EncodeOptions are the encoder's command line options. A block size of 0
+/// codes the whole input as one block; interleaving applies to every block,
+/// including that one. Blocks are encoded side by side on numThreads threads.
+/// With a model, every input is encoded against its codes (see model.h) and
+/// maxCodeLength is not used; the caller keeps the model alive. Adaptive
+/// encoding picks a table per block instead (see adaptive.h), it does not
+/// apply with a model. Input (or with adaptive encoding, a block) that coding
+/// would not shrink by minSaving is stored as it is; with a model, that is
+/// only known once the input is coded, which is then thrown away.
+/// </summary>
+struct EncodeOptions {
+    uint64_t blockSize = 0;   // input bytes per block, 0 for a single block
+    bool interleaved = false; // code each block as INTERLEAVED_STREAMS streams
+    int maxCodeLength = 0;    // longest code allowed, 0 for MAX_CODE_LENGTH
+    int numThreads = 1;
+    const Model* model = nullptr; // shared model to encode against instead of each input's own codes
+    bool adaptive = false;        // reuse, replace or skip the table block by block
+    double minSaving = DEFAULT_MIN_SAVING; // store what coding would shrink by less than this (0 to 1)
+};
+
+/// <summary>
+/// An Encoder turns a buffer into a container, byte for byte what
+/// encode-parallel writes for the same options. It keeps its tree, code
+/// table and block writers between calls, so encoding many buffers with one
+/// Encoder stops allocating once the writers have grown to size. With a
+/// model, the codes are made once up front and no input is counted at all.
+/// </summary>
+class Encoder {
+public:
+    explicit Encoder(const EncodeOptions& options = EncodeOptions());
+
+    // encode `input` into `output` (replacing what was there), returns 0 on success and 1 if the codes
+    // cannot be made to fit in options.maxCodeLength bits or adaptive blocks are below MIN_ADAPTIVE_BLOCK_SIZE
+    int encode(std::span<const uint8_t> input, std::vector<uint8_t>& output);
+
+private:
+    EncodeOptions options;
+    HuffmanTree tree;
+    uint8_t codeLengths[256];
+    CodeTable codes;
+    std::vector<BitWriter> blockWriters;
+    std::vector<BlockEntry> blocks;
+    std::vector<Histogram> blockCounts;
+    BlockPlan plan;
+};
+
+/// <summary>
+/// A Decoder turns a container back into the original bytes. Blocks are
+/// decoded side by side on numThreads threads, and a single plain block is
+/// split up and resynchronized (see selfsync.h). It keeps its decode table,
+/// block index and chunks between calls. Given the model that containers
+/// were encoded against, it builds that model's table once and uses it for
+/// all of them. Legacy files (which need their tree.json) are not supported.
+/// </summary>
+class Decoder {
+public:
+    explicit Decoder(int numThreads = 1, const Model* model = nullptr);
+
+    // decode the container in `input` into `output` (replacing what was there), returns 0 on success
+    // and 1 if it is not a container this decoder can read (or was encoded against a model it was not given), or is corrupt
+    int decode(std::span<const uint8_t> input, std::vector<uint8_t>& output);
+
+private:
+    int numThreads;
+    const Model* model;
+    DecodeTable modelTable;
+    DecodeTable table;
+    BlockCodings codings;
+    BlockTables blockTables;
+    std::vector<BlockEntry> blocks;
+    std::vector<SyncChunk> chunks;
+};
+
+// one-off forms of the above, they throw std::runtime_error where those return 1
+std::vector<uint8_t> encode(std::span<const uint8_t> input, const EncodeOptions& options = EncodeOptions());
+std::vector<uint8_t> decode(std::span<const uint8_t> encoded, int numThreads = 1, const Model* model = nullptr);
@@ -0,0 +1,113 @@
+/* mappedfile.cpp */
+
+//
+// Implementation of the memory-mapped file view
+//
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mappedfile.h"
+
+MappedFile::MappedFile()
+    : bytes(nullptr), length(0) {}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+// map the file, returns 0 on success and 1 on failure
+int MappedFile::open(const char* fileName, int hints)
+{
+    close();
+
+    int fd = ::open(fileName, O_RDONLY);
+    if (fd < 0)
+    {
+        return 1;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+    {
+        ::close(fd);
+        return 1;
+    }
+
+    // nothing to map for an empty file
+    length = static_cast<size_t>(info.st_size);
+    if (length == 0)
+    {
+        ::close(fd);
+        return 0;
+    }
+
+    int flags = MAP_PRIVATE | ((hints & POPULATE) ? MAP_POPULATE : 0);
+    void* mapped = mmap(nullptr, length, PROT_READ, flags, fd, 0);
+    ::close(fd); // the mapping keeps its own reference to the file
+    if (mapped == MAP_FAILED)
+    {
+        length = 0;
+        return 1;
+    }
+
+    // we read front to back, so ask the kernel for aggressive read-ahead
+    madvise(mapped, length, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+    if (hints & HUGE_PAGES)
+    {
+        madvise(mapped, length, MADV_HUGEPAGE);
+    }
+#endif
+    bytes = static_cast<unsigned char*>(mapped);
+    return 0;
+}
+
+// create (or truncate) a file of `fileSize` bytes and map it writable, returns 0 on success and 1 on failure
+int MappedFile::create(const char* fileName, size_t fileSize)
+{
+    close();
+
+    int fd = ::open(fileName, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        return 1;
+    }
+    if (ftruncate(fd, static_cast<off_t>(fileSize)) != 0)
+    {
+        ::close(fd);
+        return 1;
+    }
+
+    // nothing to map for an empty file
+    if (fileSize == 0)
+    {
+        ::close(fd);
+        return 0;
+    }
+
+    void* mapped = mmap(nullptr, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED)
+    {
+        return 1;
+    }
+
+    bytes = static_cast<unsigned char*>(mapped);
+    length = fileSize;
+    return 0;
+}
+
+// unmap the file (also done by the destructor)
+void MappedFile::close()
+{
+    if (bytes)
+    {
+        munmap(bytes, length);
+    }
+    bytes = nullptr;
+    length = 0;
+}
@@ -0,0 +1,51 @@
+/* mappedfile.h */
+
+//
+// Read-only memory-mapped view of a file
+//
+
+#pragma once
+
+#include <cstddef>
+
+/// <summary>
+/// A MappedFile maps a whole file read-only into memory, so it can be read
+/// in place instead of being copied into a buffer first. It can also create
+/// an output file of a known size and map it writable, so several threads can
+/// fill in their own parts of it. The mapping is released when the object
+/// goes out of scope. Empty files are valid and simply have no data.
+///
+/// Read-only maps are always advised for sequential access. Callers that
+/// will touch every page can also ask for the whole file to be faulted in up
+/// front (MAP_POPULATE) and for transparent huge pages, which cut page faults
+/// and TLB misses on very large inputs. Both are hints the kernel may ignore.
+/// </summary>
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // optional hints for open(), combined with |
+    static const int POPULATE = 1;  // read the whole file in while mapping it
+    static const int HUGE_PAGES = 2; // back the mapping with huge pages where the kernel supports it
+
+    // map the file, returns 0 on success and 1 on failure
+    int open(const char* fileName, int hints = 0);
+
+    // create (or truncate) a file of `fileSize` bytes and map it writable, returns 0 on success and 1 on failure
+    int create(const char* fileName, size_t fileSize);
+
+    // unmap the file (also done by the destructor)
+    void close();
+
+    const unsigned char* data() const { return bytes; }
+    unsigned char* writableData() { return bytes; }
+    size_t size() const { return length; }
+
+private:
+    unsigned char* bytes;
+    size_t length;
+};
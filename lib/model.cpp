@@ -0,0 +1,87 @@
+/* model.cpp */
+
+//
+// Training, saving and loading shared models
+//
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+#include "huffman.h"
+#include "model.h"
+
+// train a model on the byte counts of the sample files
+int trainModel(const uint64_t freqs[256], int maxCodeLength, Model& model)
+{
+    // doubling the real counts keeps every byte that appeared above the escapes, which count 1
+    uint64_t weights[256];
+    for (int c = 0; c < 256; c++)
+    {
+        weights[c] = (freqs[c] > 0) ? freqs[c] * 2 : 1;
+    }
+
+    HuffmanTree tree;
+    buildHuffmanTree(weights, tree);
+    computeCodeLengths(tree, model.codeLengths);
+    int limit = (maxCodeLength > 0) ? maxCodeLength : MAX_CODE_LENGTH;
+    if (*std::max_element(model.codeLengths, model.codeLengths + 256) > limit && limitCodeLengths(weights, limit, model.codeLengths) != 0)
+    {
+        return 1;
+    }
+    model.id = codeLengthsId(model.codeLengths);
+    return 0;
+}
+
+// save a model
+int writeModel(const char* fileName, const Model& model)
+{
+    std::vector<unsigned char> bytes(MODEL_MAGIC, MODEL_MAGIC + sizeof(MODEL_MAGIC));
+    writeCodeLengths(model.codeLengths, bytes);
+
+    std::ofstream out(fileName, std::ofstream::binary);
+    out.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    out.close();
+    return out ? 0 : 1;
+}
+
+// load a model
+int readModel(const char* fileName, Model& model)
+{
+    std::ifstream in(fileName, std::ifstream::binary);
+    if (!in)
+    {
+        return 1;
+    }
+    std::vector<unsigned char> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (bytes.size() < sizeof(MODEL_MAGIC) || !std::equal(MODEL_MAGIC, MODEL_MAGIC + sizeof(MODEL_MAGIC), bytes.begin()))
+    {
+        return 1;
+    }
+
+    // every byte needs a code, and the codes have to form a prefix code
+    size_t used = readCodeLengths(bytes.data() + sizeof(MODEL_MAGIC), bytes.size() - sizeof(MODEL_MAGIC), model.codeLengths);
+    uint64_t codes[256];
+    if (used == 0 || std::count(model.codeLengths, model.codeLengths + 256, 0) != 0 || assignCanonicalCodes(model.codeLengths, codes) != 0)
+    {
+        return 1;
+    }
+    model.id = codeLengthsId(model.codeLengths);
+    return 0;
+}
+
+// swap in the model's code lengths if the container was encoded against a shared model
+int useModel(const ContainerHeader& header, uint64_t modelId, const Model* model, uint8_t codeLengths[256])
+{
+    if (!(header.flags & FLAG_SHARED_MODEL))
+    {
+        return 0;
+    }
+    if (!model || model->id != modelId)
+    {
+        return 1;
+    }
+    std::copy(model->codeLengths, model->codeLengths + 256, codeLengths);
+    return 0;
+}
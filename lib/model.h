@@ -0,0 +1,46 @@
+/* model.h */
+
+//
+// Code tables trained once on sample files and shared by every file encoded against them
+//
+
+#pragma once
+
+#include <cstdint>
+
+#include "container.h"
+
+/// <summary>
+/// A Model is a set of code lengths trained on a sample corpus (say, the logs
+/// of one service) and saved, so files with the same kind of content can be
+/// encoded against it without a frequency pass of their own and without
+/// carrying their own code lengths: their container stores only the model's
+/// id (FLAG_SHARED_MODEL), and the decoder loads the model once for all of them.
+///
+/// Every byte value has a code, so any input can be encoded against any
+/// model. Bytes the samples never had get escape codes: they are counted as
+/// rarer than every byte that did appear, so they share the deepest part of
+/// the tree and cost the common bytes as little as possible.
+///
+/// A model file is MODEL_MAGIC followed by the code lengths (see writeCodeLengths).
+/// </summary>
+const char MODEL_MAGIC[8] = {'H', 'C', 'M', 'O', 'D', 'E', 'L', '1'};
+
+struct Model {
+    uint8_t codeLengths[256];
+    uint64_t id; // codeLengthsId(codeLengths), what containers encoded against it store
+};
+
+// train a model on the byte counts of the sample files, with codes of at most `maxCodeLength`
+// bits (0 for MAX_CODE_LENGTH), returns 0 on success and 1 if that many bits cannot cover every byte
+int trainModel(const uint64_t freqs[256], int maxCodeLength, Model& model);
+
+// save a model, returns 0 on success and 1 on failure
+int writeModel(const char* fileName, const Model& model);
+
+// load a model, returns 0 on success and 1 if it cannot be read or is not a valid model
+int readModel(const char* fileName, Model& model);
+
+// swap in the model's code lengths if the container was encoded against a shared model
+// returns 0 on success, 1 if it was and `model` is missing or not the one it was encoded against
+int useModel(const ContainerHeader& header, uint64_t modelId, const Model* model, uint8_t codeLengths[256]);
@@ -0,0 +1,46 @@
+/* options.cpp */
+
+//
+// Implementation of the option value parsers
+//
+
+#include <cstdlib>
+
+#include "options.h"
+
+// a number with an optional K, M or G suffix
+int parseSize(const char* text, uint64_t& size)
+{
+    char* end = nullptr;
+    size = strtoull(text, &end, 10);
+    if (end == text)
+    {
+        return 1;
+    }
+    switch (*end)
+    {
+        case '\0': break;
+        case 'K': case 'k': size <<= 10; end++; break;
+        case 'M': case 'm': size <<= 20; end++; break;
+        case 'G': case 'g': size <<= 30; end++; break;
+        default: return 1;
+    }
+    return *end == '\0' ? 0 : 1;
+}
+
+// a number from 0 to 100 with an optional % sign
+int parsePercent(const char* text, double& fraction)
+{
+    char* end = nullptr;
+    double percent = strtod(text, &end);
+    if (end == text || percent < 0 || percent > 100)
+    {
+        return 1;
+    }
+    if (*end == '%')
+    {
+        end++;
+    }
+    fraction = percent / 100;
+    return *end == '\0' ? 0 : 1;
+}
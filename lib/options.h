@@ -0,0 +1,16 @@
+/* options.h */
+
+//
+// Parsing of command-line option values shared by the programs
+//
+
+#pragma once
+
+#include <cstdint>
+
+// parse a size such as 4096, 64K, 1M or 2G, returns 0 on success and 1 if the text is not a size
+int parseSize(const char* text, uint64_t& size);
+
+// parse a percentage such as 1, 0.5 or 2% into a fraction (0 to 1)
+// returns 0 on success, 1 if the text is not a percentage from 0 to 100
+int parsePercent(const char* text, double& fraction);
@@ -0,0 +1,216 @@
+/* outputwriter.cpp */
+
+//
+// Implementation of the buffered output file
+//
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "outputwriter.h"
+
+OutputWriter::OutputWriter()
+    : fd(-1), async(false), failed(false), current(0), filled(0), pendingChunk(0), pendingLength(0), stopping(false) {}
+
+OutputWriter::~OutputWriter()
+{
+    close();
+}
+
+// create (or truncate) the file
+int OutputWriter::open(const char* fileName, bool async)
+{
+    close();
+
+    fd = ::open(fileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        return 1;
+    }
+    this->async = async;
+    failed = false;
+    current = 0;
+    filled = 0;
+    chunks[0].resize(CHUNK_SIZE);
+    if (async)
+    {
+        chunks[1].resize(CHUNK_SIZE);
+        writer = std::thread(&OutputWriter::writeChunks, this);
+    }
+    return 0;
+}
+
+// take bytes written in place
+void OutputWriter::commit(size_t length)
+{
+    filled += length;
+    if (filled == CHUNK_SIZE)
+    {
+        flush();
+    }
+}
+
+// append bytes
+void OutputWriter::write(const unsigned char* data, size_t length)
+{
+    // without a background writer, copying a large span first would only cost time
+    if (!async && length >= CHUNK_SIZE)
+    {
+        flush();
+        failed |= (writeAll(fd, data, length) != 0);
+        return;
+    }
+    while (length > 0)
+    {
+        size_t part = std::min(length, spaceLeft());
+        memcpy(space(), data, part);
+        commit(part);
+        data += part;
+        length -= part;
+    }
+}
+
+// overwrite bytes already written
+void OutputWriter::writeAt(uint64_t offset, const unsigned char* data, size_t length)
+{
+    // they may still be in a chunk
+    flush();
+    wait();
+    while (length > 0)
+    {
+        ssize_t written = pwrite(fd, data, length, static_cast<off_t>(offset));
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written <= 0)
+        {
+            failed = true;
+            return;
+        }
+        data += written;
+        offset += static_cast<uint64_t>(written);
+        length -= static_cast<size_t>(written);
+    }
+}
+
+// write out what is left and close the file
+int OutputWriter::close()
+{
+    if (fd < 0)
+    {
+        return 1;
+    }
+    flush();
+    wait();
+    if (writer.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        changed.notify_all();
+        writer.join();
+        stopping = false;
+    }
+    failed |= (::close(fd) != 0);
+    fd = -1;
+    return failed ? 1 : 0;
+}
+
+// write a whole file that is already in memory
+int OutputWriter::writeFile(const char* fileName, const unsigned char* data, size_t length)
+{
+    int fd = ::open(fileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        return 1;
+    }
+    int failed = writeAll(fd, data, length);
+    return (::close(fd) != 0) ? 1 : failed;
+}
+
+// write out the current chunk and start on the other one
+void OutputWriter::flush()
+{
+    if (filled == 0)
+    {
+        return;
+    }
+    if (!async)
+    {
+        failed |= (writeAll(fd, chunks[current].data(), filled) != 0);
+        filled = 0;
+        return;
+    }
+
+    // only one write at a time, so the file stays in order and the other chunk is free again
+    wait();
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        pendingChunk = current;
+        pendingLength = filled;
+    }
+    changed.notify_all();
+    current ^= 1;
+    filled = 0;
+}
+
+// wait for the background write
+void OutputWriter::wait()
+{
+    if (!writer.joinable())
+    {
+        return;
+    }
+    std::unique_lock<std::mutex> guard(lock);
+    changed.wait(guard, [this]() { return pendingLength == 0; });
+}
+
+// write out each chunk handed over by flush, until close says to stop (after the last one)
+void OutputWriter::writeChunks()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    while (true)
+    {
+        changed.wait(guard, [this]() { return pendingLength > 0 || stopping; });
+        if (pendingLength == 0)
+        {
+            return;
+        }
+
+        // the caller is busy with the other chunk meanwhile, and only looks at `failed` once this one is done
+        const unsigned char* data = chunks[pendingChunk].data();
+        size_t length = pendingLength;
+        guard.unlock();
+        int result = writeAll(fd, data, length);
+        guard.lock();
+        failed |= (result != 0);
+        pendingLength = 0;
+        changed.notify_all();
+    }
+}
+
+// write(2) until all of it is out
+int OutputWriter::writeAll(int fd, const unsigned char* data, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t written = ::write(fd, data, length);
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written <= 0)
+        {
+            return 1;
+        }
+        data += written;
+        length -= static_cast<size_t>(written);
+    }
+    return 0;
+}
@@ -0,0 +1,93 @@
+/* outputwriter.h */
+
+//
+// Buffered output file written with write(2) in large chunks
+//
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// <summary>
+/// An OutputWriter collects output in a chunk of CHUNK_SIZE bytes and hands
+/// each full chunk to write(2) at once, so a decoder can decode straight into
+/// the chunk (space/commit) instead of going through a stream call per piece.
+/// Spans of a chunk or more bypass the buffer and are written directly.
+///
+/// In async mode there are two chunks: while a background thread writes one
+/// out, the caller fills the other, so decoding the next chunk overlaps the
+/// write of the previous one. Everything, large spans included, then goes
+/// through the chunks, so the caller never waits for the disk unless both are
+/// full. The thread is started when the file is opened and handed each full
+/// chunk in turn, and only stops when the file is closed.
+///
+/// Errors are remembered rather than reported at each call; close() says
+/// whether everything made it to the file. The file is closed when the object
+/// goes out of scope.
+/// </summary>
+class OutputWriter {
+public:
+    static const size_t CHUNK_SIZE = 1 << 20;
+
+    OutputWriter();
+    ~OutputWriter();
+
+    OutputWriter(const OutputWriter&) = delete;
+    OutputWriter& operator=(const OutputWriter&) = delete;
+
+    // create (or truncate) the file, returns 0 on success and 1 on failure
+    int open(const char* fileName, bool async = false);
+
+    // the free part of the current chunk, to be filled in place and then committed
+    unsigned char* space() { return chunks[current].data() + filled; }
+    size_t spaceLeft() const { return CHUNK_SIZE - filled; }
+
+    // take `length` bytes written into space(), writing the chunk out once it is full
+    void commit(size_t length);
+
+    // append `length` bytes
+    void write(const unsigned char* data, size_t length);
+
+    // overwrite `length` bytes at `offset`, which must already have been written (such as a placeholder header)
+    void writeAt(uint64_t offset, const unsigned char* data, size_t length);
+
+    // write out what is left and close the file, returns 0 if every write succeeded and 1 otherwise
+    int close();
+
+    // write a whole file that is already in memory with no chunk at all (such as one file of a batch)
+    // returns 0 on success and 1 on failure
+    static int writeFile(const char* fileName, const unsigned char* data, size_t length);
+
+private:
+    // write out the current chunk (in the background in async mode) and start on the other one
+    void flush();
+
+    // wait for the background write, if there is one
+    void wait();
+
+    // the background thread: write out each chunk it is handed until the file is closed
+    void writeChunks();
+
+    // write(2) until all of it is out, returns 0 on success and 1 on failure
+    static int writeAll(int fd, const unsigned char* data, size_t length);
+
+    int fd;
+    bool async;
+    bool failed;
+    std::vector<unsigned char> chunks[2];
+    int current;
+    size_t filled;
+
+    // async mode: the chunk handed to the writer thread (none while pendingLength is 0), guarded by `lock`
+    std::thread writer;
+    std::mutex lock;
+    std::condition_variable changed;
+    int pendingChunk;
+    size_t pendingLength;
+    bool stopping;
+};
@@ -0,0 +1,157 @@
+/* selfsync.cpp */
+
+//
+// Implementation of the self-synchronizing parallel decode
+//
+
+#include <algorithm>
+
+#include <omp.h>
+
+#include "selfsync.h"
+
+// decode the symbols that start in [reader.position(), endBit) onto the end of `out`
+static void decodeRange(const DecodeTable& table, BitReader& reader, uint64_t endBit, std::vector<unsigned char>& out)
+{
+    // guess at about 4 bits a symbol, and double whenever that was too few
+    size_t count = out.size();
+    uint64_t bits = (endBit > reader.position()) ? endBit - reader.position() : 0;
+    out.resize(count + static_cast<size_t>(bits / 4) + 256);
+    while (true)
+    {
+        size_t room = out.size() - count;
+        size_t decoded = table.decodeUntil(reader, endBit, out.data() + count, room);
+        count += decoded;
+        if (decoded < room)
+        {
+            break;
+        }
+        out.resize(out.size() * 2);
+    }
+    out.resize(count);
+}
+
+// decode a chunk from its (probably misaligned) first bit, remembering where the first symbols start
+static void decodeSpeculative(const DecodeTable& table, const unsigned char* data, size_t size, uint64_t totalBits, SyncChunk& chunk)
+{
+    BitReader reader(data, size, totalBits);
+    reader.seek(chunk.beginBit);
+
+    // one symbol at a time while the start bits are still wanted
+    while (chunk.starts.size() < SYNC_WINDOW && reader.position() < chunk.endBit)
+    {
+        uint64_t start = reader.position();
+        unsigned char symbol;
+        if (table.decodeUntil(reader, chunk.endBit, &symbol, 1) == 0)
+        {
+            break;
+        }
+        chunk.starts.push_back(start);
+        chunk.symbols.push_back(symbol);
+    }
+
+    // then the rest in bulk
+    decodeRange(table, reader, chunk.endBit, chunk.symbols);
+    chunk.stopBit = reader.position();
+    chunk.complete = (chunk.stopBit >= chunk.endBit);
+}
+
+// decode bits [0, totalBits) of one bitstream on up to `numThreads` threads
+void decodeSelfSync(const DecodeTable& table, const unsigned char* data, size_t size, uint64_t totalBits, int numThreads, std::vector<SyncChunk>& chunks)
+{
+    uint64_t chunkCount = std::max<uint64_t>(1, std::min<uint64_t>(numThreads, totalBits / MIN_SYNC_CHUNK_BITS));
+    chunks.assign(static_cast<size_t>(chunkCount), SyncChunk{});
+    for (size_t i = 0; i < chunks.size(); i++)
+    {
+        chunks[i].beginBit = totalBits * i / chunkCount;
+        chunks[i].endBit = totalBits * (i + 1) / chunkCount;
+    }
+
+    // every chunk decodes from its own first bit at once (the first chunk's decode is the real one)
+    #pragma omp parallel for schedule(static, 1) num_threads(numThreads)
+    for (size_t i = 0; i < chunks.size(); i++) {
+        decodeSpeculative(table, data, size, totalBits, chunks[i]);
+    }
+
+    // fix-up: walk the real decode from where the previous chunk stopped until it meets this chunk's decode
+    chunks[0].syncIndex = 0;
+    chunks[0].synced = true;
+    uint64_t bit = chunks[0].stopBit;
+    bool complete = chunks[0].complete;
+    for (size_t i = 1; i < chunks.size(); i++)
+    {
+        SyncChunk& chunk = chunks[i];
+        chunk.syncIndex = chunk.symbols.size();
+        chunk.synced = false;
+        if (!complete)
+        {
+            // a sequential decode stops at bits that match no code, so nothing after them is kept
+            continue;
+        }
+
+        BitReader reader(data, size, totalBits);
+        reader.seek(bit);
+        size_t next = 0;
+        while (reader.position() < chunk.endBit)
+        {
+            uint64_t position = reader.position();
+            while (next < chunk.starts.size() && chunk.starts[next] < position)
+            {
+                next++;
+            }
+            if (next == chunk.starts.size())
+            {
+                break;
+            }
+            if (chunk.starts[next] == position)
+            {
+                chunk.syncIndex = next;
+                chunk.synced = true;
+                break;
+            }
+            unsigned char symbol;
+            if (table.decodeUntil(reader, chunk.endBit, &symbol, 1) == 0)
+            {
+                break;
+            }
+            chunk.prefix.push_back(symbol);
+        }
+
+        if (chunk.synced)
+        {
+            // from here on the speculative decode is the real one
+            bit = chunk.stopBit;
+            complete = chunk.complete;
+        }
+        else
+        {
+            // never met (or the chunk was too short to): decode the rest of it here
+            decodeRange(table, reader, chunk.endBit, chunk.prefix);
+            bit = reader.position();
+            complete = (bit >= chunk.endBit);
+        }
+    }
+}
+
+// the same, then copy the first `length` symbols into `out`
+size_t decodeSelfSync(const DecodeTable& table, const unsigned char* data, size_t size, uint64_t totalBits, int numThreads, unsigned char* out, size_t length, std::vector<SyncChunk>& chunks)
+{
+    decodeSelfSync(table, data, size, totalBits, numThreads, chunks);
+
+    // where each chunk lands
+    std::vector<size_t> offsets(chunks.size() + 1, 0);
+    for (size_t i = 0; i < chunks.size(); i++)
+    {
+        offsets[i + 1] = std::min(length, offsets[i] + chunks[i].size());
+    }
+
+    #pragma omp parallel for schedule(static, 1) num_threads(numThreads)
+    for (size_t i = 0; i < chunks.size(); i++) {
+        const SyncChunk& chunk = chunks[i];
+        size_t prefixBytes = std::min(chunk.prefix.size(), offsets[i + 1] - offsets[i]);
+        // copy_n rather than memcpy: a chunk that synced at once has no prefix, whose data() may be null
+        std::copy_n(chunk.prefix.data(), prefixBytes, out + offsets[i]);
+        std::copy_n(chunk.symbols.data() + chunk.syncIndex, offsets[i + 1] - offsets[i] - prefixBytes, out + offsets[i] + prefixBytes);
+    }
+    return offsets.back();
+}
@@ -0,0 +1,53 @@
+/* selfsync.h */
+
+//
+// Parallel decoding of a single Huffman bitstream, using self-synchronization
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "decodetable.h"
+
+// symbols whose start bits each chunk remembers, for matching up with the chunk before it
+const size_t SYNC_WINDOW = 4096;
+
+// chunks smaller than this are not worth a thread
+const uint64_t MIN_SYNC_CHUNK_BITS = uint64_t(1) << 20;
+
+/// <summary>
+/// A SyncChunk is one thread's share of a single bitstream. The thread starts
+/// decoding at beginBit, which most likely falls in the middle of a code, so
+/// its first few symbols are garbage. Huffman codes resynchronize quickly,
+/// though: once this decode and the one coming from the previous chunk land
+/// on the same symbol boundary, they agree from there on. The fix-up pass
+/// decodes the symbols before that boundary itself (prefix), so the chunk's
+/// output is prefix followed by symbols[syncIndex...]. If the two never meet
+/// within the first SYNC_WINDOW symbols, the fix-up pass decodes the whole
+/// chunk again and synced is false.
+/// </summary>
+struct SyncChunk {
+    uint64_t beginBit;
+    uint64_t endBit;                    // symbols that start before this bit belong to the chunk
+    std::vector<unsigned char> symbols; // speculative decode, starting at beginBit
+    std::vector<uint64_t> starts;       // start bit of each of the first SYNC_WINDOW speculative symbols
+    uint64_t stopBit;                   // where the speculative decode stopped
+    bool complete;                      // did it get to endBit (rather than stop at bits that match no code)?
+    std::vector<unsigned char> prefix;  // symbols decoded by the fix-up pass
+    size_t syncIndex;                   // first speculative symbol that is kept
+    bool synced;
+
+    // decoded bytes of this chunk (after decodeSelfSync)
+    size_t size() const { return prefix.size() + symbols.size() - syncIndex; }
+};
+
+// decode bits [0, totalBits) of one bitstream on up to `numThreads` threads; afterwards the chunks,
+// in order, hold exactly the symbols a sequential DecodeTable::decode() of the whole stream gives
+void decodeSelfSync(const DecodeTable& table, const unsigned char* data, size_t size, uint64_t totalBits, int numThreads, std::vector<SyncChunk>& chunks);
+
+// the same, then copy the first `length` symbols into `out` and return how many there were
+// (the 0s padding the last byte can decode to a few symbols too many, those are cut off)
+size_t decodeSelfSync(const DecodeTable& table, const unsigned char* data, size_t size, uint64_t totalBits, int numThreads, unsigned char* out, size_t length, std::vector<SyncChunk>& chunks);
@@ -0,0 +1,114 @@
+/* spscqueue.h */
+
+//
+// Bounded lock-free queue from one producer thread to one consumer thread,
+// and the wait that it and other lock-free hand-overs between threads use
+//
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// wait until `ready()` returns true, yielding the CPU for a while and then sleeping briefly between tries,
+// so a stage waiting on a slow disk does not keep a core busy; returns false if `abort` was set first
+template <typename Ready>
+bool waitUntil(Ready ready, const std::atomic<bool>& abort)
+{
+    for (int spins = 0; !ready(); spins++)
+    {
+        if (abort.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        if (spins < 64)
+        {
+            std::this_thread::yield();
+        }
+        else
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    }
+    return true;
+}
+
+/// <summary>
+/// An SpscQueue hands items from exactly one producer thread to exactly one
+/// consumer thread through a fixed ring, without locks. Each side only ever
+/// writes its own index and reads the other's with acquire ordering, so an
+/// item is completely written before the consumer can see it. The indices
+/// sit on separate cache lines so the two sides do not slow each other down.
+///
+/// push and pop never block. waitPush and waitPop wait (see waitUntil) until
+/// they can go ahead or `abort` is set, which is how a pipeline of these
+/// queues is shut down when one of its stages fails.
+/// </summary>
+template <typename T>
+class SpscQueue {
+public:
+    // room for at least `capacity` items
+    explicit SpscQueue(size_t capacity)
+        : slots(roundUp(capacity)), mask(slots.size() - 1), head(0), tail(0) {}
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // add an item (producer only), returns false if the queue is full
+    bool push(const T& item)
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == slots.size())
+        {
+            return false;
+        }
+        slots[t & mask] = item;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // take the oldest item (consumer only), returns false if the queue is empty
+    bool pop(T& item)
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        item = slots[h & mask];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // push, waiting for room, returns false if `abort` was set first
+    bool waitPush(const T& item, const std::atomic<bool>& abort)
+    {
+        return waitUntil([&]() { return push(item); }, abort);
+    }
+
+    // pop, waiting for an item, returns false if `abort` was set first
+    bool waitPop(T& item, const std::atomic<bool>& abort)
+    {
+        return waitUntil([&]() { return pop(item); }, abort);
+    }
+
+private:
+    // smallest power of 2 that is at least `n` (and at least 1), so an index wraps with a mask
+    static size_t roundUp(size_t n)
+    {
+        size_t size = 1;
+        while (size < n)
+        {
+            size <<= 1;
+        }
+        return size;
+    }
+
+    std::vector<T> slots;
+    size_t mask;
+    alignas(64) std::atomic<size_t> head; // next item to pop, written by the consumer
+    alignas(64) std::atomic<size_t> tail; // next free slot, written by the producer
+};
@@ -0,0 +1,135 @@
+/* stats.cpp */
+
+//
+// Implementation of the timing and counter output
+//
+
+#include <algorithm>
+
+#include <sys/resource.h>
+
+#include "stats.h"
+
+Stats::Stats()
+    : format(NONE) {}
+
+// is `arg` a --stats=<format> option?
+bool Stats::isOption(const std::string& arg, Format& format)
+{
+    const std::string prefix = "--stats=";
+    if (arg.compare(0, prefix.size(), prefix) != 0)
+    {
+        return false;
+    }
+    std::string name = arg.substr(prefix.size());
+    format = (name == "json") ? JSON : (name == "csv") ? CSV : NONE;
+    return true;
+}
+
+void Stats::enable(const std::string& programName, Format outputFormat)
+{
+    program = programName;
+    format = outputFormat;
+}
+
+// record a stage that took `elapsed`
+void Stats::addStage(const char* name, std::chrono::nanoseconds elapsed)
+{
+    if (enabled())
+    {
+        stages.push_back({name, static_cast<uint64_t>(elapsed.count())});
+    }
+}
+
+// set a counter
+void Stats::setCounter(const char* name, uint64_t value)
+{
+    if (enabled())
+    {
+        counters.push_back({name, value});
+    }
+}
+
+// start a parallel region and return one zeroed ThreadWork per thread
+ThreadWork* Stats::beginRegion(const char* name, int threads)
+{
+    if (!enabled())
+    {
+        return nullptr;
+    }
+    regions.push_back({name, std::vector<ThreadWork>(threads, ThreadWork{0, 0, 0})});
+    return regions.back().threads.data();
+}
+
+// slowest thread over the average thread
+double Stats::imbalance(const Region& region)
+{
+    uint64_t total = 0;
+    uint64_t slowest = 0;
+    for (const ThreadWork& work : region.threads)
+    {
+        total += work.ns;
+        slowest = std::max(slowest, work.ns);
+    }
+    return (total == 0) ? 1.0 : static_cast<double>(slowest) * region.threads.size() / total;
+}
+
+// print everything in the chosen format
+void Stats::print(std::ostream& os) const
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    long peakRssKb = usage.ru_maxrss;
+
+    if (format == CSV)
+    {
+        os << "program,kind,name,thread,value" << std::endl;
+        for (const auto& [name, ns] : stages)
+        {
+            os << program << ",stage_ns," << name << ",," << ns << std::endl;
+        }
+        for (const auto& [name, value] : counters)
+        {
+            os << program << ",counter," << name << ",," << value << std::endl;
+        }
+        for (const Region& region : regions)
+        {
+            for (size_t t = 0; t < region.threads.size(); t++)
+            {
+                os << program << ",thread_ns," << region.name << "," << t << "," << region.threads[t].ns << std::endl;
+                os << program << ",thread_bytes," << region.name << "," << t << "," << region.threads[t].bytes << std::endl;
+                os << program << ",thread_items," << region.name << "," << t << "," << region.threads[t].items << std::endl;
+            }
+            os << program << ",imbalance," << region.name << ",," << imbalance(region) << std::endl;
+        }
+        os << program << ",peak_rss_kb,,," << peakRssKb << std::endl;
+        return;
+    }
+
+    if (format == JSON)
+    {
+        os << "{\"program\": \"" << program << "\", \"stages_ns\": {";
+        for (size_t i = 0; i < stages.size(); i++)
+        {
+            os << (i ? ", " : "") << "\"" << stages[i].first << "\": " << stages[i].second;
+        }
+        os << "}, \"counters\": {";
+        for (size_t i = 0; i < counters.size(); i++)
+        {
+            os << (i ? ", " : "") << "\"" << counters[i].first << "\": " << counters[i].second;
+        }
+        os << "}, \"regions\": [";
+        for (size_t r = 0; r < regions.size(); r++)
+        {
+            const Region& region = regions[r];
+            os << (r ? ", " : "") << "{\"name\": \"" << region.name << "\", \"imbalance\": " << imbalance(region) << ", \"threads\": [";
+            for (size_t t = 0; t < region.threads.size(); t++)
+            {
+                const ThreadWork& work = region.threads[t];
+                os << (t ? ", " : "") << "{\"ns\": " << work.ns << ", \"bytes\": " << work.bytes << ", \"items\": " << work.items << "}";
+            }
+            os << "]}";
+        }
+        os << "], \"peak_rss_kb\": " << peakRssKb << "}" << std::endl;
+    }
+}
@@ -0,0 +1,87 @@
+/* stats.h */
+
+//
+// Machine-readable timings and counters (--stats=json or --stats=csv)
+//
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/// <summary>
+/// ThreadWork is what one thread did in one parallel region: time spent
+/// working and how many bytes and items (blocks, ranges) it got through.
+/// Each sits on its own cache line, since the threads fill them in side by side.
+/// </summary>
+struct alignas(64) ThreadWork {
+    uint64_t ns;
+    uint64_t bytes;
+    uint64_t items;
+
+    void add(uint64_t elapsedNs, uint64_t byteCount)
+    {
+        ns += elapsedNs;
+        bytes += byteCount;
+        items++;
+    }
+};
+
+/// <summary>
+/// Stats collects named stage times (nanoseconds), counters, per-thread work
+/// for the OpenMP regions and the peak resident memory, and prints them as
+/// JSON or CSV once the program is done. Nothing is recorded unless it was
+/// enabled, and nothing is recorded inside the per-byte loops: stages and
+/// regions are timed around them, so a disabled Stats costs a branch per stage.
+/// </summary>
+class Stats {
+public:
+    enum Format { NONE, JSON, CSV };
+
+    Stats();
+
+    // is `arg` a --stats=<format> option? sets `format` (NONE for an unknown format)
+    static bool isOption(const std::string& arg, Format& format);
+
+    // current time in nanoseconds, for timing regions
+    static uint64_t now()
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    void enable(const std::string& programName, Format outputFormat);
+    bool enabled() const { return format != NONE; }
+
+    // record a stage that took `elapsed`
+    void addStage(const char* name, std::chrono::nanoseconds elapsed);
+
+    // set a counter
+    void setCounter(const char* name, uint64_t value);
+
+    // start a parallel region and return one zeroed ThreadWork per thread (nullptr when disabled)
+    ThreadWork* beginRegion(const char* name, int threads);
+
+    // print everything in the chosen format
+    void print(std::ostream& os) const;
+
+private:
+    struct Region {
+        std::string name;
+        std::vector<ThreadWork> threads;
+    };
+
+    // slowest thread over the average thread (1 = perfectly balanced)
+    static double imbalance(const Region& region);
+
+    Format format;
+    std::string program;
+    std::vector<std::pair<std::string, uint64_t>> stages;
+    std::vector<std::pair<std::string, uint64_t>> counters;
+    std::deque<Region> regions; // a deque so handed-out ThreadWork pointers stay valid
+};